@@ -0,0 +1,625 @@
+#include "cacti.h"
+#include "clock.h"
+#include "err.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/* Benchmarks of canonical actor workloads. Each workload runs in a forked process
+ * for each worker count, so that the peak RSS it reports is its own.
+ * Usage: cacti_bench [-w workers,...] [-s scale] [workload...]
+ * Results are printed to the standard output as CSV. */
+
+/* Latency of one in (SAMPLE_MASK + 1) messages is recorded. */
+#define SAMPLE_MASK 15
+#define MAX_SAMPLES (1 << 20)
+#define MAX_WORKER_COUNTS 16
+
+static long *samples;
+static _Atomic size_t nsamples;
+static _Thread_local unsigned sample_tick;
+
+/* Records the latency of a message sent at the given time. */
+static void record(long sent) {
+    if ((++sample_tick & SAMPLE_MASK) != 0)
+        return;
+    size_t i = atomic_fetch_add_explicit(&nsamples, 1, memory_order_relaxed);
+    if (i < MAX_SAMPLES)
+        samples[i] = monotonic_nanos() - sent;
+}
+
+static void create_system(actor_id_t *leader, role_t *role, size_t workers) {
+    if (actor_system_create_ex(leader, role,
+            &(actor_system_config_t){.pool_size = workers}) != 0)
+        fatal("failed to create actor system");
+}
+
+static void godie() {
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+/* Ping-pong: two actors pass a message back and forth. */
+
+#define PP_HOPS 200000L
+
+typedef struct {
+    long sent;
+    long hop;
+    actor_id_t from;
+} pp_msg_t;
+
+static long pp_hops;
+
+void pp_hello(void **stateptr, size_t nbytes, void *data);
+void pp_ping(void **stateptr, size_t nbytes, pp_msg_t *data);
+
+act_t pp_prompts[] = {pp_hello, (act_t)pp_ping};
+role_t pp_role = {.nprompts = 2, .prompts = pp_prompts};
+
+void pp_hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    pp_msg_t msg = {.sent = monotonic_nanos(), .hop = 0, .from = actor_id_self()};
+    send_message_inline((actor_id_t)data, 1, &msg, sizeof(msg));
+}
+
+void pp_ping(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        pp_msg_t *data) {
+    record(data->sent);
+    if (data->hop == pp_hops) {
+        send_message(data->from, (message_t){.message_type = MSG_GODIE});
+        godie();
+        return;
+    }
+    pp_msg_t msg = {.sent = monotonic_nanos(), .hop = data->hop + 1, .from = actor_id_self()};
+    send_message_inline(data->from, 1, &msg, sizeof(msg));
+}
+
+static unsigned long run_pingpong(size_t workers, long scale) {
+    actor_id_t leader;
+    pp_hops = PP_HOPS * scale;
+    create_system(&leader, &pp_role, workers);
+    send_message(leader, (message_t){.message_type = MSG_SPAWN, .data = &pp_role});
+    actor_system_join(leader);
+    return pp_hops + 1;
+}
+
+/* Fan-in: many producers flood a single consumer. */
+
+#define FI_PRODUCERS 64
+#define FI_MESSAGES 20000L
+
+static long fi_messages;
+
+void fi_hello(void **stateptr, size_t nbytes, void *data);
+void fi_item(void **stateptr, size_t nbytes, void *data);
+
+act_t fi_prompts[] = {fi_hello, fi_item};
+role_t fi_role = {.nprompts = 2, .prompts = fi_prompts};
+
+void fi_hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    for (long i = 0; i < fi_messages; ++i)
+        send_message((actor_id_t)data, (message_t){.message_type = 1, .data = (void*)monotonic_nanos()});
+    godie();
+}
+
+void fi_item(void **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    record((long)data);
+    long received = (long)*stateptr + 1;
+    *stateptr = (void*)received;
+    if (received == FI_PRODUCERS * fi_messages)
+        godie();
+}
+
+static unsigned long run_fanin(size_t workers, long scale) {
+    actor_id_t leader;
+    fi_messages = FI_MESSAGES * scale;
+    create_system(&leader, &fi_role, workers);
+    for (int i = 0; i < FI_PRODUCERS; ++i)
+        send_message(leader, (message_t){.message_type = MSG_SPAWN, .data = &fi_role});
+    actor_system_join(leader);
+    return FI_PRODUCERS * fi_messages;
+}
+
+/* Inline fan-in: producers send small messages inline to a single consumer, which
+ * gives them credit for the next window of messages. As the number of messages in flight
+ * is bounded, their mailbox nodes can be reused by the producers, which never consume. */
+
+#define FII_PRODUCERS 16
+#define FII_WINDOW 16 // messages a producer sends before it waits for credit
+
+typedef struct {
+    long sent;
+    actor_id_t from;
+    bool credit; // the producer waits for credit after this message
+} fii_msg_t;
+
+static long fii_messages;
+
+void fii_hello(void **stateptr, size_t nbytes, void *data);
+void fii_item(void **stateptr, size_t nbytes, void *data);
+void fii_credit(void **stateptr, size_t nbytes, void *data);
+
+act_t fii_prompts[] = {fii_hello, fii_item, fii_credit};
+role_t fii_role = {.nprompts = 3, .prompts = fii_prompts};
+
+static actor_id_t fii_consumer;
+
+/* Sends the next window of messages, the count of sent ones kept in the state. */
+static void fii_window(void **stateptr) {
+    long sent = (long)*stateptr;
+    for (int i = 0; i < FII_WINDOW && sent < fii_messages; ++i) {
+        ++sent;
+        fii_msg_t msg = {.sent = monotonic_nanos(), .from = actor_id_self(),
+                .credit = i + 1 == FII_WINDOW && sent < fii_messages};
+        send_message_inline(fii_consumer, 1, &msg, sizeof(msg));
+    }
+    *stateptr = (void*)sent;
+    if (sent == fii_messages)
+        godie();
+}
+
+void fii_hello(void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    fii_window(stateptr);
+}
+
+void fii_item(void **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    fii_msg_t *msg = data;
+    record(msg->sent);
+    if (msg->credit)
+        send_message(msg->from, (message_t){.message_type = 2});
+    long received = (long)*stateptr + 1;
+    *stateptr = (void*)received;
+    if (received == FII_PRODUCERS * fii_messages)
+        godie();
+}
+
+void fii_credit(void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    fii_window(stateptr);
+}
+
+static unsigned long run_fanin_inline(size_t workers, long scale) {
+    fii_messages = FI_MESSAGES * FI_PRODUCERS / FII_PRODUCERS * scale;
+    create_system(&fii_consumer, &fii_role, workers);
+    for (int i = 0; i < FII_PRODUCERS; ++i)
+        send_message(fii_consumer, (message_t){.message_type = MSG_SPAWN, .data = &fii_role});
+    actor_system_join(fii_consumer);
+    return FII_PRODUCERS * fii_messages;
+}
+
+/* Fan-out: the leader broadcasts rounds of messages to many receivers. */
+
+#define FO_RECEIVERS 1000
+#define FO_ROUNDS 200L
+
+typedef struct {
+    actor_id_t receivers[FO_RECEIVERS];
+    size_t nreceivers;
+    long round;
+} fo_leader_t;
+
+static long fo_rounds;
+
+void fo_hello(void **stateptr, size_t nbytes, void *data);
+void fo_ready(fo_leader_t **stateptr, size_t nbytes, void *data);
+void fo_round(fo_leader_t **stateptr, size_t nbytes, void *data);
+void fo_item(void **stateptr, size_t nbytes, void *data);
+
+act_t fo_prompts[] = {fo_hello, (act_t)fo_ready, (act_t)fo_round, fo_item};
+role_t fo_role = {.nprompts = 4, .prompts = fo_prompts};
+
+void fo_hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    send_message((actor_id_t)data, (message_t){.message_type = 1, .data = (void*)actor_id_self()});
+}
+
+void fo_ready(fo_leader_t **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    if (*stateptr == NULL && (*stateptr = calloc(1, sizeof(fo_leader_t))) == NULL)
+        fatal("calloc failed");
+    (*stateptr)->receivers[(*stateptr)->nreceivers++] = (actor_id_t)data;
+    if ((*stateptr)->nreceivers == FO_RECEIVERS)
+        send_message(actor_id_self(), (message_t){.message_type = 2});
+}
+
+void fo_round(fo_leader_t **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    send_multicast((*stateptr)->receivers, FO_RECEIVERS,
+            (message_t){.message_type = 3, .data = (void*)monotonic_nanos()});
+    if (++(*stateptr)->round < fo_rounds) {
+        send_message(actor_id_self(), (message_t){.message_type = 2});
+    } else {
+        free(*stateptr);
+        godie();
+    }
+}
+
+void fo_item(void **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    record((long)data);
+    long received = (long)*stateptr + 1;
+    *stateptr = (void*)received;
+    if (received == fo_rounds)
+        godie();
+}
+
+static unsigned long run_fanout(size_t workers, long scale) {
+    actor_id_t leader;
+    fo_rounds = FO_ROUNDS * scale;
+    create_system(&leader, &fo_role, workers);
+    for (int i = 0; i < FO_RECEIVERS; ++i)
+        send_message(leader, (message_t){.message_type = MSG_SPAWN, .data = &fo_role});
+    actor_system_join(leader);
+    return FO_RECEIVERS * fo_rounds;
+}
+
+/* Skynet: a tree of actors ten children wide is spawned recursively,
+ * leaves report their numbers and inner actors sum them up. */
+
+#define SK_WIDTH 10
+#define SK_DEPTH 5
+
+typedef struct {
+    long sent;
+    long number;
+    int level;
+    actor_id_t parent;
+} sk_assign_t;
+
+typedef struct {
+    sk_assign_t self;
+    int children;
+    int pending;
+    long sum;
+} sk_state_t;
+
+static long sk_total;
+
+void sk_hello(void **stateptr, size_t nbytes, void *data);
+void sk_ready(sk_state_t **stateptr, size_t nbytes, void *data);
+void sk_assign(sk_state_t **stateptr, size_t nbytes, sk_assign_t *data);
+void sk_result(sk_state_t **stateptr, size_t nbytes, long *data);
+
+act_t sk_prompts[] = {sk_hello, (act_t)sk_ready, (act_t)sk_assign, (act_t)sk_result};
+role_t sk_role = {.nprompts = 4, .prompts = sk_prompts};
+
+void sk_hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    send_message((actor_id_t)data, (message_t){.message_type = 1, .data = (void*)actor_id_self()});
+}
+
+void sk_ready(sk_state_t **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    sk_assign_t assign = {.sent = monotonic_nanos(),
+            .number = (*stateptr)->self.number * SK_WIDTH + (*stateptr)->children++,
+            .level = (*stateptr)->self.level + 1, .parent = actor_id_self()};
+    send_message_inline((actor_id_t)data, 2, &assign, sizeof(assign));
+}
+
+static void sk_report(sk_state_t *state, long value) {
+    if (state->self.parent >= 0)
+        send_message_inline(state->self.parent, 3, &value, sizeof(value));
+    else
+        sk_total = value;
+    free(state);
+    godie();
+}
+
+void sk_assign(sk_state_t **stateptr, __attribute__((unused)) size_t nbytes, sk_assign_t *data) {
+    record(data->sent);
+    if ((*stateptr = calloc(1, sizeof(sk_state_t))) == NULL)
+        fatal("calloc failed");
+    (*stateptr)->self = *data;
+    if (data->level == SK_DEPTH) {
+        sk_report(*stateptr, data->number);
+        return;
+    }
+    (*stateptr)->pending = SK_WIDTH;
+    for (int i = 0; i < SK_WIDTH; ++i)
+        send_message(actor_id_self(), (message_t){.message_type = MSG_SPAWN, .data = &sk_role});
+}
+
+void sk_result(sk_state_t **stateptr, __attribute__((unused)) size_t nbytes, long *data) {
+    (*stateptr)->sum += *data;
+    if (--(*stateptr)->pending == 0)
+        sk_report(*stateptr, (*stateptr)->sum);
+}
+
+static unsigned long run_skynet(size_t workers, __attribute__((unused)) long scale) {
+    actor_id_t leader;
+    long leaves = 1, edges = 0;
+    for (int i = 0; i < SK_DEPTH; ++i) {
+        leaves *= SK_WIDTH;
+        edges += leaves;
+    }
+
+    create_system(&leader, &sk_role, workers);
+    sk_assign_t root = {.sent = monotonic_nanos(), .number = 0, .level = 0, .parent = -1};
+    send_message_inline(leader, 2, &root, sizeof(root));
+    actor_system_join(leader);
+    if (sk_total != leaves * (leaves - 1) / 2)
+        fatal("skynet computed %ld", sk_total);
+    // spawn, hello, ready, assign and result for each child
+    return 5 * edges;
+}
+
+/* Chain: each actor spawns the next one and dies, as in silnia. */
+
+#define CH_LENGTH 100000L
+
+typedef struct {
+    long sent;
+    long step;
+} ch_msg_t;
+
+static long ch_length;
+
+void ch_hello(void **stateptr, size_t nbytes, void *data);
+void ch_ready(void **stateptr, size_t nbytes, void *data);
+void ch_assign(void **stateptr, size_t nbytes, ch_msg_t *data);
+
+act_t ch_prompts[] = {ch_hello, ch_ready, (act_t)ch_assign};
+role_t ch_role = {.nprompts = 3, .prompts = ch_prompts};
+
+void ch_hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    send_message((actor_id_t)data, (message_t){.message_type = 1, .data = (void*)actor_id_self()});
+}
+
+void ch_ready(void **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    ch_msg_t msg = {.sent = monotonic_nanos(), .step = (long)*stateptr + 1};
+    send_message_inline((actor_id_t)data, 2, &msg, sizeof(msg));
+    godie();
+}
+
+void ch_assign(void **stateptr, __attribute__((unused)) size_t nbytes, ch_msg_t *data) {
+    record(data->sent);
+    *stateptr = (void*)data->step;
+    if (data->step == ch_length)
+        godie();
+    else
+        send_message(actor_id_self(), (message_t){.message_type = MSG_SPAWN, .data = &ch_role});
+}
+
+static unsigned long run_chain(size_t workers, long scale) {
+    actor_id_t leader;
+    ch_length = CH_LENGTH * scale < CAST_LIMIT ? CH_LENGTH * scale : CAST_LIMIT - 1;
+    create_system(&leader, &ch_role, workers);
+    ch_msg_t first = {.sent = monotonic_nanos(), .step = 1};
+    send_message_inline(leader, 2, &first, sizeof(first));
+    actor_system_join(leader);
+    // spawn, hello, ready and assign for each step
+    return 4 * ch_length;
+}
+
+/* Pipeline: rows flow through a chain of column actors, as in macierz. */
+
+#define PL_COLUMNS 16
+#define PL_ROWS 20000L
+#define PL_FEED_BATCH 64
+
+typedef struct {
+    long sent;
+    long row;
+    long sum;
+} pl_row_t;
+
+typedef struct {
+    int column;
+    actor_id_t child;
+    actor_id_t leader;
+    long next_row; // leader only
+} pl_state_t;
+
+static long pl_rows;
+
+void pl_hello(void **stateptr, size_t nbytes, void *data);
+void pl_ready(pl_state_t **stateptr, size_t nbytes, void *data);
+void pl_assign(pl_state_t **stateptr, size_t nbytes, pl_state_t *data);
+void pl_feed(pl_state_t **stateptr, size_t nbytes, void *data);
+void pl_row(pl_state_t **stateptr, size_t nbytes, pl_row_t *data);
+
+act_t pl_prompts[] = {pl_hello, (act_t)pl_ready, (act_t)pl_assign, (act_t)pl_feed,
+                      (act_t)pl_row};
+role_t pl_role = {.nprompts = 5, .prompts = pl_prompts};
+
+void pl_hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    send_message((actor_id_t)data, (message_t){.message_type = 1, .data = (void*)actor_id_self()});
+}
+
+void pl_ready(pl_state_t **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    (*stateptr)->child = (actor_id_t)data;
+    pl_state_t child = {.column = (*stateptr)->column + 1, .child = -1,
+            .leader = (*stateptr)->leader};
+    send_message_inline((*stateptr)->child, 2, &child, sizeof(child));
+}
+
+void pl_assign(pl_state_t **stateptr, __attribute__((unused)) size_t nbytes, pl_state_t *data) {
+    if ((*stateptr = malloc(sizeof(pl_state_t))) == NULL)
+        fatal("malloc failed");
+    **stateptr = *data;
+    if (data->column + 1 < PL_COLUMNS)
+        send_message(actor_id_self(), (message_t){.message_type = MSG_SPAWN, .data = &pl_role});
+    else
+        send_message(data->leader, (message_t){.message_type = 3});
+}
+
+void pl_feed(pl_state_t **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    message_t batch[PL_FEED_BATCH + 1];
+    size_t n = 0;
+    // A row is started by a message carrying just its number, the next batch
+    // is fed after the rows of this one.
+    for (; n < PL_FEED_BATCH && (*stateptr)->next_row < pl_rows; ++n) {
+        batch[n] = (message_t){.message_type = 4, .nbytes = 0,
+                .data = (void*)((*stateptr)->next_row++)};
+    }
+    if ((*stateptr)->next_row < pl_rows)
+        batch[n++] = (message_t){.message_type = 3};
+    send_messages(actor_id_self(), batch, n);
+}
+
+void pl_row(pl_state_t **stateptr, size_t nbytes, pl_row_t *data) {
+    pl_row_t row;
+    if (nbytes == 0) // a new row started by the leader
+        row = (pl_row_t){.sent = monotonic_nanos(), .row = (long)data, .sum = 0};
+    else
+        row = *data;
+    row.sum += row.row + (*stateptr)->column;
+
+    if ((*stateptr)->column + 1 < PL_COLUMNS)
+        send_message_inline((*stateptr)->child, 4, &row, sizeof(row));
+    else
+        record(row.sent);
+
+    if (row.row + 1 == pl_rows) {
+        free(*stateptr);
+        godie();
+    }
+}
+
+static unsigned long run_pipeline(size_t workers, long scale) {
+    actor_id_t leader;
+    pl_rows = PL_ROWS * scale;
+    create_system(&leader, &pl_role, workers);
+    pl_state_t first = {.column = 0, .child = -1, .leader = leader, .next_row = 0};
+    send_message_inline(leader, 2, &first, sizeof(first));
+    actor_system_join(leader);
+    return PL_COLUMNS * pl_rows;
+}
+
+/* Driver */
+
+typedef struct {
+    const char *name;
+    unsigned long (*run)(size_t workers, long scale); // returns the number of messages
+} workload_t;
+
+static const workload_t workloads[] = {
+    {"pingpong", run_pingpong},
+    {"fanin", run_fanin},
+    {"fanin_inline", run_fanin_inline},
+    {"fanout", run_fanout},
+    {"skynet", run_skynet},
+    {"chain", run_chain},
+    {"pipeline", run_pipeline},
+};
+
+#define NWORKLOADS (sizeof(workloads) / sizeof(workload_t))
+
+static int compare_longs(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+static long percentile(size_t n, double p) {
+    if (n == 0)
+        return -1;
+    size_t i = (size_t)(p / 100.0 * (double)(n - 1) + 0.5);
+    return samples[i];
+}
+
+/* Runs in a child process */
+static void run_one(const workload_t *workload, size_t workers, long scale) {
+    if ((samples = malloc(MAX_SAMPLES * sizeof(long))) == NULL)
+        fatal("malloc failed");
+    atomic_init(&nsamples, 0);
+
+    long start = monotonic_nanos();
+    unsigned long messages = workload->run(workers, scale);
+    double seconds = (double)(monotonic_nanos() - start) / 1e9;
+
+    size_t n = atomic_load(&nsamples);
+    if (n > MAX_SAMPLES)
+        n = MAX_SAMPLES;
+    qsort(samples, n, sizeof(long), compare_longs);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("%s,%zu,%lu,%.6f,%.0f,%ld,%ld,%ld,%ld\n", workload->name, workers, messages, seconds,
+            (double)messages / seconds, percentile(n, 50), percentile(n, 99), percentile(n, 99.9),
+            usage.ru_maxrss);
+    free(samples);
+}
+
+static size_t parse_workers(char *list, size_t *workers) {
+    size_t n = 0;
+    for (char *tok = strtok(list, ","); tok != NULL && n < MAX_WORKER_COUNTS;
+            tok = strtok(NULL, ",")) {
+        long w = atol(tok);
+        if (w <= 0)
+            fatal("Bad worker count: %s", tok);
+        workers[n++] = (size_t)w;
+    }
+    return n;
+}
+
+static size_t default_workers(size_t *workers) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t n = 0;
+    for (size_t w = 1; w < (size_t)cpus && n < MAX_WORKER_COUNTS - 1; w *= 2)
+        workers[n++] = w;
+    workers[n++] = cpus > 0 ? (size_t)cpus : 1;
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    size_t workers[MAX_WORKER_COUNTS];
+    size_t nworkers = 0;
+    long scale = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:s:")) != -1) {
+        switch (opt) {
+            case 'w':
+                nworkers = parse_workers(optarg, workers);
+                break;
+            case 's':
+                if ((scale = atol(optarg)) <= 0)
+                    fatal("Bad scale: %s", optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-w workers,...] [-s scale] [workload...]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (nworkers == 0)
+        nworkers = default_workers(workers);
+
+    puts("workload,workers,messages,seconds,msgs_per_sec,p50_ns,p99_ns,p999_ns,max_rss_kb");
+    fflush(stdout);
+
+    int failed = 0;
+    for (size_t i = 0; i < NWORKLOADS; ++i) {
+        bool selected = optind == argc;
+        for (int j = optind; j < argc; ++j)
+            selected |= strcmp(argv[j], workloads[i].name) == 0;
+        if (!selected)
+            continue;
+
+        for (size_t w = 0; w < nworkers; ++w) {
+            pid_t pid = fork();
+            if (pid == -1)
+                syserr(errno, "fork failed");
+            if (pid == 0) {
+                run_one(&workloads[i], workers[w], scale);
+                fflush(stdout);
+                _exit(0);
+            }
+            int status;
+            if (waitpid(pid, &status, 0) == -1)
+                syserr(errno, "waitpid failed");
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "%s with %zu workers failed\n", workloads[i].name, workers[w]);
+                failed = 1;
+            }
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,9 @@
+#ifndef CACTI_CACHELINE_H
+#define CACTI_CACHELINE_H
+
+/* Data written by different threads is kept at least this far apart */
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+#endif //CACTI_CACHELINE_H
@@ -1,429 +1,2068 @@
+#define _GNU_SOURCE // pthread_attr_setaffinity_np
+
 #include <pthread.h>
+#include <semaphore.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <signal.h>
 #include <assert.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "err.h"
+#include "clock.h"
 #include "cacti.h"
-#include "message_queue.h"
+#include "cacheline.h"
+#include "mailbox.h"
 #include "actors_queue.h"
+#include "run_queue.h"
+#include "timer_wheel.h"
+#include "io_service.h"
+#include "registry.h"
+#include "slab.h"
+#include "msg_pool.h"
+#include "stats.h"
+#include "trace.h"
+#include "topology.h"
 
 #ifdef DEBUG
 #include <stdio.h>
 #endif
 
-/* Defines the maximal number of messages that one thread may process on an actor
- * before returning to actors queue. */
-#define MAX_MESSAGES_PROCESSED_IN_ONE_ITERATION 1
+/* Defines how many times the message budget may be extended for an actor
+ * with a deep mailbox. */
+#define BUDGET_MAX_SCALE 8
+
+#define INITIAL_ACTORS_CAPACITY REGISTRY_CHUNK_SIZE
+
+/* Defines how often (in scheduling rounds) a worker looks into the global queue
+ * even if its own run queue is not empty. */
+#define GLOBAL_QUEUE_CHECK_INTERVAL 61
+
+/* Defines how many actors in a row a worker may take from its next slot; the actor
+ * made runnable after that goes to the back of the run queue, so that a pair of actors
+ * messaging each other does not starve the rest. */
+#define RUN_NEXT_LIMIT 16
+
+/* Defines how many times an idle worker tries to steal work before it parks. */
+#define SPIN_ROUNDS 64
+
+/* Defines how many receivers of a multicast are scheduled at once. */
+#define MULTICAST_SCHEDULE_BATCH 64
+
+/* Defines how many queues threads outside of the pool wait for room in mailboxes in;
+ * the queue of a mailbox is chosen by the index of its actor. */
+#define ROOM_QUEUES 16
+
+/* Shared payloads */
+/* Carries a shared_message_t inline; it is taken apart before the handler is called. */
+#define MSG_SHARED (message_type_t)0x05ba2ed0
+
+typedef struct {
+    _Atomic size_t refs;
+    size_t size;
+    _Alignas(max_align_t) unsigned char data[];
+} shared_payload_t;
+
+typedef struct {
+    message_type_t message_type;
+    void *data;
+} shared_message_t;
+
+_Static_assert(sizeof(shared_message_t) <= INLINE_PAYLOAD_LIMIT,
+        "a message carrying a shared payload has to fit inline");
 
-#define INITIAL_ACTOR_ARR_CAPACITY 8
+static shared_payload_t *shared_of(void *const data) {
+    return (shared_payload_t *)((char *)data - offsetof(shared_payload_t, data));
+}
+
+/* Payloads come from the message pools, which let any thread free them. */
+void *cacti_shared_alloc(size_t size) {
+    shared_payload_t *shared = cacti_msg_alloc(sizeof(shared_payload_t) + size);
+    if (shared == NULL)
+        return NULL;
+    atomic_init(&shared->refs, 1);
+    shared->size = size;
+    return shared->data;
+}
+
+void cacti_shared_retain(void *data) {
+    atomic_fetch_add_explicit(&shared_of(data)->refs, 1, memory_order_relaxed);
+}
+
+void cacti_shared_release(void *data) {
+    shared_payload_t *const shared = shared_of(data);
+    // the writes of all the holders happen before the payload is freed
+    if (atomic_fetch_sub_explicit(&shared->refs, 1, memory_order_acq_rel) == 1)
+        cacti_msg_free(shared);
+}
 
 /* Actor state struct & operations */
+/* Fields are grouped by the threads writing them, so that the senders of an actor and
+ * the worker running it do not keep taking cache lines from each other. */
 typedef struct {
-    bool gone_die;
-    bool worked_at;
-    void *state;
+    // Read by the senders and the worker, written once the actor is spawned.
     actor_id_t id;
-    role_t role;
-    pthread_mutex_t mutex;
-    message_queue_t queue;
+    size_t node; // where the actor is scheduled when it is made runnable off its node
+    atomic_bool *gone_die; // kept in the registry, see interrupt_system
+    role_t role; // its priority is the index of the queues the actor is scheduled in
+    mailbox_t mailbox;
+    // Written by the worker running the actor
+    void *state;
+    _Atomic size_t room_waiters; // threads outside of the pool waiting for room, see wait_for_room
+#ifdef CACTI_STATS
+    stat_counter_t processed;
+#endif
 } act_state_t;
 
-static int act_state_init(act_state_t *const state, role_t *const role, actor_id_t new_id) {
+_Static_assert(offsetof(act_state_t, mailbox) <= CACHE_LINE_SIZE,
+        "fields read by the senders have to fit in a cache line");
+
+static int act_state_init(act_state_t *const state, role_t *const role, actor_id_t new_id,
+        size_t node, atomic_bool *const gone_die) {
     assert(state && role);
-    if (pthread_mutex_init(&state->mutex, NULL) != 0)
-        return -1;
-    if (message_queue_init(&state->queue, ACTOR_QUEUE_LIMIT) != 0) {
-        pthread_mutex_destroy(&state->mutex);
-        return -1;
-    }
-    state->gone_die = false;
-    state->worked_at = false;
+    mailbox_init(&state->mailbox, ACTOR_QUEUE_LIMIT);
     state->id = new_id;
+    state->node = node;
+    state->gone_die = gone_die;
     state->role = *role;
+    if ((size_t)role->priority >= CACTI_PRIORITIES)
+        state->role.priority = CACTI_PRIORITIES - 1;
     state->state = NULL;
+    atomic_init(&state->room_waiters, 0);
+    stats(atomic_init(&state->processed, 0));
     return 0;
 }
 
 static void act_state_destroy(act_state_t *const state) {
-    int err;
-    mutex_destroy(&state->mutex);
-    message_queue_destroy(&state->queue);
+    // messages are left only by an interrupted system
+    mailbox_node_t *node;
+    while ((node = mailbox_pop(&state->mailbox)) != NULL) {
+        if (node->message.message_type == MSG_SHARED)
+            cacti_shared_release(((shared_message_t *)node->message.data)->data);
+        mailbox_node_free(node);
+    }
+    mailbox_destroy(&state->mailbox);
 }
 
-/* Actor states array struct & operations */
-typedef struct {
-    size_t capacity;
-    size_t size;
-    act_state_t **arr; // array of malloc'd pointers
-    pthread_rwlock_t rwlock; // ensures safety of realloc operation
-} act_state_arr;
-
-static int act_state_arr_init(act_state_arr *const arr) {
-    assert(arr);
-    arr->capacity = INITIAL_ACTOR_ARR_CAPACITY;
-    arr->size = 0;
-    arr->arr = malloc(arr->capacity * sizeof(act_state_t*));
-    if (arr->arr == NULL)
-        return 1;
-
-    if (pthread_rwlock_init(&arr->rwlock, NULL) != 0) {
-        free(arr->arr);
-        return -1;
-    }
+/* Actor states live in slabs, so spawning is a pointer bump and
+ * actors spawned one after another share pages. */
+static act_state_t *act_state_new(slab_allocator_t *const slab, role_t *const role,
+        actor_id_t new_id, size_t node, atomic_bool *const gone_die) {
+    act_state_t *state = slab_alloc(slab);
+    if (act_state_init(state, role, new_id, node, gone_die) != 0)
+        fatal("Failed to initialize actor state");
+    return state;
+}
 
-    return 0;
+/* The memory of the states is released with the slab allocators of the workers. */
+static void act_states_clear(registry_t *const actors) {
+    size_t size = registry_size(actors);
+    for (size_t i = 0; i < size; ++i) {
+        act_state_t *state = registry_get(actors, (actor_id_t)i);
+        if (state != NULL)
+            act_state_destroy(state);
+    }
+    registry_clear(actors);
 }
 
-static int act_state_arr_emplace(act_state_arr *const arr, role_t *const role,
-        actor_id_t new_id) {
-    int err;
-    assert(arr && role);
-    assert(arr->size < CAST_LIMIT);
+/* Worker thread structure */
+/* Workers are kept in arrays, each of them starting a cache line. */
+typedef struct worker {
+    _Alignas(CACHE_LINE_SIZE) pthread_t thread;
+    struct actor_system *system;
+    size_t id;
+    size_t node; // index of the worker's node in the system
+    actor_id_t actor; // being run, see actor_id_self()
+    unsigned rand_state; // victim selection when stealing
+    unsigned long tick; // number of scheduling rounds so far
+    unsigned next_streak; // actors taken from the next slot in a row
+    bool throttled; // the running actor has overfilled some mailbox
+    bool spinning; // the worker is looking for work, see struct actor_system
+    slab_allocator_t act_states; // states of actors spawned by this worker, on its node
+    // Fields below are written by other workers as well.
+    _Alignas(CACHE_LINE_SIZE) sem_t wakeup; // a parked worker sleeps on it
+    // Fields below are guarded by the actor system mutex.
+    bool parked;
+    bool wake_spinning; // the worker is woken up to look for work, not to finish
+    struct worker *next_idle;
+    run_queue_t run_queues[CACTI_PRIORITIES]; // the next slot of the normal one is used
+#ifdef CACTI_STATS
+    worker_stats_t stats;
+#endif
+#ifdef CACTI_TRACE
+    trace_ring_t *trace;
+#endif
+} worker_t;
 
-    rwlock_wrlock(&arr->rwlock);
+/* Workers of one NUMA node, which share global queues, one per priority */
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex; // guards queues
+    actors_queue_t queues[CACTI_PRIORITIES]; // actors scheduled by threads off the node
+    _Atomic size_t queue_sizes[CACTI_PRIORITIES]; // allow peeking without the mutex
+    worker_t *workers; // consecutive ones
+    size_t nworkers;
+} node_t;
+
+/* Threads outside of the pool waiting for room in mailboxes of some actors */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t room;
+    size_t waiters; // guarded by mutex
+} room_queue_t;
 
-    if (arr->capacity == arr->size) {
-        arr->capacity *= 2;
-        if ((arr->arr = realloc(arr->arr, sizeof(act_state_t*) * arr->capacity)) == NULL)
-            fatal("realloc failed");
-    }
+/* Actor system structure & operations */
+/* Fields read on every message come first, followed by the ones written as actors come,
+ * go and get scheduled, on lines of their own. The rest is touched as the system starts
+ * and ends. */
+struct actor_system {
+    size_t slot; // in systems, also the high bits of ids of the system's actors
+    size_t pool_size;
+    worker_t *workers;
+    // Workers are grouped by NUMA node. An actor lives on the node of its spawner,
+    // and workers look for work on their own node before reaching to other ones.
+    node_t *nodes;
+    size_t nnodes;
+    size_t spin_rounds; // 0 if there is a single CPU to spin on
+    _Atomic size_t budget_messages; // system budget, see budget_t
+    _Atomic long budget_nanos;
+    bool interrupted;
+    registry_t actors;
+    // Idle workers first spin looking for work, then park. A new runnable actor
+    // wakes a parked worker only if no worker is spinning, and the last spinning
+    // worker to find work wakes up a successor, as the work may not be over.
+    _Alignas(CACHE_LINE_SIZE) _Atomic size_t idle_threads;
+    _Atomic size_t spinning;
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex;
+    worker_t *idle_workers; // parked workers, guarded by mutex
+    size_t alive_threads;
+    _Alignas(CACHE_LINE_SIZE) _Atomic size_t alive_actors;
+    room_queue_t room_queues[ROOM_QUEUES];
+#ifdef CACTI_STATS
+    _Atomic unsigned long sent_outside; // messages sent by threads outside of the pool
+#endif
+    bool has_handle; // the memory is released by actor_system_wait
+    bool finished; // guarded by systems_lock
+    // A finished system keeps its threads and memory for a later one of the same shape.
+    unsigned long generation; // number of systems run so far, guarded by systems_lock
+    size_t stack_size; // of the threads, 0 for the default
+    bool bound; // threads and memory are bound to NUMA nodes
+    bool pinned; // threads are pinned to the CPUs given in the configuration
+    bool retired; // threads end instead of waiting for another system, guarded by mutex
+    struct actor_system *next_spare;
+    // Timers are fired by a thread of their own, started with the first timer.
+    pthread_mutex_t timer_mutex; // guards the fields below
+    pthread_cond_t timer_cond; // on CLOCK_MONOTONIC
+    timer_wheel_t timers;
+    pthread_t timer_thread;
+    bool timer_started;
+    bool timer_stop;
+    long timer_wake; // tick the timer thread sleeps until, -1 if it waits for a timer
+    io_service_t io; // serves cacti_io_submit
+    cacti_future_t *futures; // waiting for replies from the system, guarded by futures_locks[slot]
+#ifdef CACTI_TRACE
+    trace_ring_t *outside_trace; // events of threads outside of the pool
+    trace_epoch_t trace_epoch;
+    char *trace_path;
+#endif
+};
 
-    arr->arr[arr->size] = malloc(sizeof(act_state_t));
-    if (arr->arr[arr->size] == NULL)
-        fatal("malloc failed");
-    int res = act_state_init(arr->arr[arr->size++], role, new_id);
+_Static_assert(CAST_LIMIT <= 1L << CACTI_SYSTEM_SHIFT, "actor index has to fit below the slot");
+
+/* Running systems, indexed by slot. Slot 0 belongs to the default system. Systems share
+ * nothing but this table, which is only written when a system starts or ends. */
+static struct actor_system *_Atomic systems[CACTI_MAX_SYSTEMS];
+
+/* Guards systems lifetime and lets actor_system_join wait for their end */
+static pthread_mutex_t systems_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t system_destroyed = PTHREAD_COND_INITIALIZER;
+static size_t running_systems; // guarded by systems_lock
+static struct sigaction old_sigact; // SIGINT handling before the first system started
+static topology_t machine; // guarded by systems_lock, detected with the first system
+static bool machine_detected;
+static struct actor_system *spare_systems; // finished ones, guarded by systems_lock
+static size_t nspare_systems;
 
-    rwlock_unlock(&arr->rwlock);
-    return res;
+/* Worker run by the current thread, NULL outside of the pool */
+static _Thread_local worker_t *curr_worker = NULL;
+
+static actor_id_t actor_id_make(size_t slot, actor_id_t index) {
+    return (actor_id_t)slot << CACTI_SYSTEM_SHIFT | index;
 }
 
-static void act_state_arr_destroy(act_state_arr *const arr) {
-    int err;
-    assert(arr);
-    for (size_t i = 0; i < arr->size; ++i) {
-        act_state_destroy(arr->arr[i]);
-        free(arr->arr[i]);
-    }
-    rwlock_destroy(&arr->rwlock);
-    free(arr->arr);
+/* Index of the actor in the registry of its system */
+static actor_id_t actor_index(actor_id_t actor) {
+    return actor & ((1L << CACTI_SYSTEM_SHIFT) - 1);
 }
 
-/* Actor system structure & operations */
-struct actor_system {
-    struct sigaction old_sigact;
-    size_t alive_threads;
-    pthread_t pool[POOL_SIZE];
-    pthread_mutex_t mutex;
-    pthread_cond_t new_request;
-    act_state_arr actors;
-    size_t alive_actors;
-    actors_queue_t act_queue;
-    bool interrupted;
-};
+/* Returns the system the actor belongs to, or NULL if it does not run. */
+static struct actor_system *system_of(actor_id_t actor) {
+    unsigned long slot = (unsigned long)actor >> CACTI_SYSTEM_SHIFT;
+    if (slot >= CACTI_MAX_SYSTEMS)
+        return NULL;
+    return atomic_load_explicit(&systems[slot], memory_order_acquire);
+}
 
-/* Global actor system - one at a time */
-struct actor_system *act_system = NULL;
+static act_state_t *actor_state(struct actor_system *const sys, actor_id_t actor) {
+    return registry_get(&sys->actors, actor_index(actor));
+}
 
-/* Used to support actor_id_self() */
-_Thread_local actor_id_t curr_actor;
+#ifdef CACTI_TRACE
+/* Events are recorded by the worker which causes them, whichever system it runs. */
+static void trace_event(struct actor_system *const sys, trace_type_t type, actor_id_t actor,
+        long arg) {
+    trace_record(curr_worker != NULL ? curr_worker->trace : sys->outside_trace,
+            type, actor, arg);
+}
 
-/* Must be called with actor system mutex locked */
-static void spawn_actor(actor_id_t *const new_actor, role_t *const role) {
-    int err;
-    if (act_system->actors.size == CAST_LIMIT)
-        fatal("Maximum number of actors exceeded");
+/* Must be called with systems_lock locked */
+static int trace_dump(struct actor_system *const sys, const char *const path) {
+    size_t nrings = sys->pool_size + 1;
+    trace_ring_t **rings = malloc(nrings * sizeof(trace_ring_t *));
+    char (*names)[32] = malloc(nrings * sizeof(*names));
+    const char **name_ptrs = malloc(nrings * sizeof(char *));
+    FILE *file = fopen(path, "w");
+    int result = -1;
+
+    if (rings != NULL && names != NULL && name_ptrs != NULL && file != NULL) {
+        for (size_t i = 0; i < sys->pool_size; ++i) {
+            rings[i] = sys->workers[i].trace;
+            snprintf(names[i], sizeof(*names), "worker %zu", i);
+            name_ptrs[i] = names[i];
+        }
+        rings[nrings - 1] = sys->outside_trace;
+        name_ptrs[nrings - 1] = "outside of the pool";
+        result = trace_write_json(file, rings, name_ptrs, nrings, &sys->trace_epoch);
+    }
+    if (file != NULL && fclose(file) != 0)
+        result = -1;
+    free(name_ptrs);
+    free(names);
+    free(rings);
+    return result;
+}
+#endif
 
-    *new_actor = act_system->actors.size;
-    ++act_system->alive_actors;
-    mutex_unlock(&act_system->mutex);
+/* Returns -1 if no more actors can be created. */
+static int spawn_actor(struct actor_system *const sys, actor_id_t *const new_actor,
+        role_t *const role) {
+    actor_id_t index = registry_reserve(&sys->actors);
+    if (index < 0)
+        return -1;
+    *new_actor = actor_id_make(sys->slot, index);
 
-    verify(act_state_arr_emplace(&act_system->actors, role, *new_actor), "malloc failed");
+    // The first actor is spawned before the workers start.
+    worker_t *const spawner = curr_worker != NULL && curr_worker->system == sys
+            ? curr_worker : &sys->workers[0];
+    atomic_fetch_add(&sys->alive_actors, 1);
+    stats(stat_add(&spawner->stats.spawned, 1));
+    registry_publish(&sys->actors, index, act_state_new(&spawner->act_states, role, *new_actor,
+            spawner->node, registry_flag(&sys->actors, index)));
+    trace(trace_event(sys, TRACE_SPAWN, *new_actor, 0));
 
     debug(printf("Spawned new actor %li.\n", *new_actor));
+    return 0;
 }
 
-static void process_message(actor_id_t actor, message_t msg) {
-    int err;
-
+static void process_message(worker_t *const self, act_state_t *const actor, message_t msg) {
+    struct actor_system *const sys = self->system;
     switch (msg.message_type) {
         case MSG_SPAWN: {
             actor_id_t new_actor;
-            if (act_system->interrupted)
+            if (sys->interrupted)
                 break;
-            mutex_lock(&act_system->mutex);
-            if (act_system->actors.size == CAST_LIMIT) {
-                mutex_unlock(&act_system->mutex);
-            } else {
-                spawn_actor(&new_actor, (role_t *) msg.data);
+            if (spawn_actor(sys, &new_actor, (role_t *) msg.data) == 0) {
                 send_message(new_actor, (message_t) {.message_type = MSG_HELLO,
                         .nbytes = sizeof(actor_id_t),
-                        .data = (void *) actor});
+                        .data = (void *) actor->id});
             }
         }
             break;
 
         case MSG_GODIE: {
-            rwlock_rdlock(&act_system->actors.rwlock);
-            act_state_t *target = act_system->actors.arr[actor];
-            rwlock_unlock(&act_system->actors.rwlock);
-
-            if (!target->gone_die) {
-                target->gone_die = true;
-                mutex_lock(&act_system->mutex);
-                --act_system->alive_actors;
-                mutex_unlock(&act_system->mutex);
+            if (!atomic_exchange_explicit(actor->gone_die, true, memory_order_relaxed)) {
+                atomic_fetch_sub(&sys->alive_actors, 1);
+                stats(stat_add(&self->stats.died, 1));
+                trace(trace_event(sys, TRACE_GODIE, actor->id, 0));
             }
         }
             break;
 
-        default: {
-            rwlock_rdlock(&act_system->actors.rwlock);
-            act_state_t *target = act_system->actors.arr[actor];
-            rwlock_unlock(&act_system->actors.rwlock);
+        case MSG_SHARED: {
+            shared_message_t shared = *(shared_message_t *)msg.data;
+            process_message(self, actor, (message_t){.message_type = shared.message_type,
+                    .nbytes = shared_of(shared.data)->size, .data = shared.data});
+            cacti_shared_release(shared.data);
+        }
+            break;
 
-            if (msg.message_type >= (message_type_t)(target->role.nprompts))
+        default: {
+            if (msg.message_type >= (message_type_t)(actor->role.nprompts))
                 fatal("Requested message number not present in actor's control array.");
 
-            target->role.prompts[msg.message_type]
-                (&target->state, msg.nbytes, msg.data);
+            actor->role.prompts[msg.message_type]
+                (&actor->state, msg.nbytes, msg.data);
+        }
+    }
+}
+
+static void nodes_destroy(node_t *const nodes, size_t nnodes) {
+    int err;
+    for (size_t i = 0; i < nnodes; ++i) {
+        mutex_destroy(&nodes[i].mutex);
+        for (size_t p = 0; p < CACTI_PRIORITIES; ++p)
+            actors_queue_destroy(&nodes[i].queues[p]);
+    }
+    free(nodes);
+}
+
+static int node_init(node_t *const node, size_t index, worker_t *const workers,
+        size_t nworkers) {
+    size_t p;
+    for (p = 0; p < CACTI_PRIORITIES; ++p) {
+        if (actors_queue_init(&node->queues[p], CAST_LIMIT) != 0)
+            goto queues_fail;
+        atomic_init(&node->queue_sizes[p], 0);
+    }
+    if (pthread_mutex_init(&node->mutex, NULL) != 0)
+        goto queues_fail;
+    node->workers = workers;
+    node->nworkers = nworkers;
+    for (size_t i = 0; i < nworkers; ++i)
+        workers[i].node = index;
+    return 0;
+
+queues_fail:
+    while (p-- > 0)
+        actors_queue_destroy(&node->queues[p]);
+    return -1;
+}
+
+/* Splits the workers into nnodes groups of consecutive ones.
+ * Returns NULL if the nodes cannot be initialized. */
+static node_t *nodes_new(worker_t *const workers, size_t pool_size, size_t nnodes) {
+    node_t *nodes = aligned_alloc(CACHE_LINE_SIZE, nnodes * sizeof(node_t));
+    if (nodes == NULL)
+        return NULL;
+    for (size_t i = 0; i < nnodes; ++i) {
+        size_t first = i * pool_size / nnodes;
+        size_t end = (i + 1) * pool_size / nnodes;
+        if (node_init(&nodes[i], i, &workers[first], end - first) != 0) {
+            nodes_destroy(nodes, i);
+            return NULL;
         }
     }
+    return nodes;
+}
+
+static void room_queues_destroy(room_queue_t *const queues, size_t n) {
+    int err;
+    for (size_t i = 0; i < n; ++i) {
+        cond_destroy(&queues[i].room);
+        mutex_destroy(&queues[i].mutex);
+    }
+}
+
+/* Returns -1 if the queues cannot be initialized. */
+static int room_queues_init(room_queue_t *const queues, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        queues[i].waiters = 0;
+        if (pthread_mutex_init(&queues[i].mutex, NULL) != 0) {
+            room_queues_destroy(queues, i);
+            return -1;
+        }
+        if (pthread_cond_init(&queues[i].room, NULL) != 0) {
+            pthread_mutex_destroy(&queues[i].mutex);
+            room_queues_destroy(queues, i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static room_queue_t *room_queue_of(struct actor_system *const sys, actor_id_t actor) {
+    return &sys->room_queues[actor_index(actor) % ROOM_QUEUES];
+}
+
+/* Futures */
+
+typedef enum {
+    FUTURE_PENDING,
+    FUTURE_READY,
+    FUTURE_BROKEN, // the system ended without a reply
+} future_state_t;
+
+struct cacti_future {
+    _Atomic future_state_t state;
+    void *result;
+    sem_t ready; // posted once the future is not pending
+    _Atomic int refs; // of the waiting and the replying side
+    size_t slot; // of the system asked
+    // pending futures of a system, guarded by futures_locks[slot]
+    cacti_future_t *next;
+    cacti_future_t **prev_next;
+};
+
+/* Guard lists of pending futures of the systems in each slot, so that systems do not
+ * contend for them. They are not kept in the systems, since a reply may come from any
+ * thread after its system has been released. Taken after systems_lock if both are needed. */
+static pthread_mutex_t futures_locks[CACTI_MAX_SYSTEMS] = {
+    [0 ... CACTI_MAX_SYSTEMS - 1] = PTHREAD_MUTEX_INITIALIZER
+};
+
+static void future_release(cacti_future_t *const future) {
+    if (atomic_fetch_sub_explicit(&future->refs, 1, memory_order_acq_rel) > 1)
+        return;
+    sem_destroy(&future->ready);
+    free(future);
+}
+
+/* Takes the future off its system's list and wakes up the waiting thread.
+ * Must be called with futures_locks[future->slot] locked. */
+static void future_complete(cacti_future_t *const future, future_state_t state,
+        void *const result) {
+    *future->prev_next = future->next;
+    if (future->next != NULL)
+        future->next->prev_next = future->prev_next;
+    future->result = result;
+    atomic_store_explicit(&future->state, state, memory_order_release);
+    if (sem_post(&future->ready) != 0)
+        syserr(errno, "sem_post failed");
+    future_release(future);
+}
+
+/* Lets the threads waiting for replies from the system go. */
+static void futures_break(struct actor_system *const sys) {
+    int err;
+    mutex_lock(&futures_locks[sys->slot]);
+    while (sys->futures != NULL)
+        future_complete(sys->futures, FUTURE_BROKEN, NULL);
+    mutex_unlock(&futures_locks[sys->slot]);
+}
+
+/* Waits for the timer thread, which may be sending messages, to end. */
+static void timers_stop(struct actor_system *const sys) {
+    int err;
+    mutex_lock(&sys->timer_mutex);
+    sys->timer_stop = true;
+    cond_signal(&sys->timer_cond);
+    bool started = sys->timer_started;
+    mutex_unlock(&sys->timer_mutex);
+    if (started)
+        verify(pthread_join(sys->timer_thread, NULL), "pthread_join failed");
+}
+
+/* Releases the system for good, once its threads have ended. */
+static void system_free(struct actor_system *const sys) {
+    int err;
+#ifdef CACTI_TRACE
+    for (size_t i = 0; i < sys->pool_size; ++i)
+        free(sys->workers[i].trace);
+    free(sys->outside_trace);
+#endif
+    io_service_destroy(&sys->io);
+    timer_wheel_destroy(&sys->timers);
+    cond_destroy(&sys->timer_cond);
+    mutex_destroy(&sys->timer_mutex);
+    room_queues_destroy(sys->room_queues, ROOM_QUEUES);
+    mutex_destroy(&sys->mutex);
+    nodes_destroy(sys->nodes, sys->nnodes);
+    registry_destroy(&sys->actors);
+    for (size_t i = 0; i < sys->pool_size; ++i) {
+        sem_destroy(&sys->workers[i].wakeup);
+        slab_allocator_destroy(&sys->workers[i].act_states);
+    }
+    free(sys->workers);
+    free(sys);
+    debug(puts("System released!"));
 }
 
-static void actor_system_destroy() {
+/* Lets the threads of a finished system end; the last one releases the system. */
+static void system_retire(struct actor_system *const sys) {
     int err;
-    if (act_system == NULL)
+    mutex_lock(&sys->mutex);
+    sys->retired = true;
+    sys->alive_threads = sys->pool_size;
+    // the woken threads cannot release the system before it is unlocked
+    for (size_t i = 0; i < sys->pool_size; ++i) {
+        if (sem_post(&sys->workers[i].wakeup) != 0)
+            syserr(errno, "sem_post failed");
+    }
+    mutex_unlock(&sys->mutex);
+}
+
+/* Keeps a finished system which nobody refers to for a later one, unless there are
+ * enough spare systems already. Must be called with systems_lock locked. */
+static void system_recycle(struct actor_system *const sys) {
+    if (sys->pinned || nspare_systems == CACTI_SPARE_SYSTEMS) {
+        system_retire(sys);
         return;
+    }
+    sys->next_spare = spare_systems;
+    spare_systems = sys;
+    ++nspare_systems;
+}
 
-    cond_destroy(&act_system->new_request);
-    mutex_destroy(&act_system->mutex);
-    actors_queue_destroy(&act_system->act_queue);
-    act_state_arr_destroy(&act_system->actors);
+/* Takes a spare system of the given shape. Must be called with systems_lock locked. */
+static struct actor_system *system_reuse(size_t pool_size, size_t stack_size, size_t nnodes,
+        bool bound) {
+    for (struct actor_system **spare = &spare_systems; *spare != NULL;
+            spare = &(*spare)->next_spare) {
+        struct actor_system *const found = *spare;
+        if (found->pool_size == pool_size && found->stack_size == stack_size &&
+                found->nnodes == nnodes && found->bound == bound) {
+            *spare = found->next_spare;
+            --nspare_systems;
+            return found;
+        }
+    }
+    return NULL;
+}
 
-    // bring the previous handling method back
-    sigaction(SIGINT, &act_system->old_sigact, NULL);
+void actor_system_release_spares() {
+    int err;
+    mutex_lock(&systems_lock);
+    while (spare_systems != NULL) {
+        struct actor_system *const sys = spare_systems;
+        spare_systems = sys->next_spare;
+        system_retire(sys);
+    }
+    nspare_systems = 0;
+    mutex_unlock(&systems_lock);
+}
+
+/* Ends the system, whose workers have finished. */
+static void system_finish(struct actor_system *const sys) {
+    int err;
+    mutex_lock(&systems_lock);
+    // From now on messages to the system's actors are rejected.
+    atomic_store_explicit(&systems[sys->slot], NULL, memory_order_release);
+    mutex_unlock(&systems_lock);
+
+    // Joining the timer and I/O threads must not hold up other systems.
+    timers_stop(sys);
+    io_service_stop(&sys->io);
+    futures_break(sys);
+
+    // Senders blocked on mailboxes of dead actors have to leave first.
+    for (size_t i = 0; i < ROOM_QUEUES; ++i) {
+        room_queue_t *const queue = &sys->room_queues[i];
+        mutex_lock(&queue->mutex);
+        while (queue->waiters > 0) {
+            cond_broadcast(&queue->room);
+            cond_wait(&queue->room, &queue->mutex);
+        }
+        mutex_unlock(&queue->mutex);
+    }
+
+    mutex_lock(&systems_lock);
+#ifdef CACTI_TRACE
+    if (sys->trace_path != NULL && trace_dump(sys, sys->trace_path) != 0)
+        fprintf(stderr, "Failed to dump the trace to %s\n", sys->trace_path);
+    free(sys->trace_path);
+    sys->trace_path = NULL;
+#endif
+
+    act_states_clear(&sys->actors);
+    for (size_t i = 0; i < sys->pool_size; ++i)
+        slab_allocator_reset(&sys->workers[i].act_states);
+
+    // bring the previous handling method back once no system runs
+    if (--running_systems == 0)
+        sigaction(SIGINT, &old_sigact, NULL);
+
+    sys->finished = true;
+    if (!sys->has_handle)
+        system_recycle(sys);
 
-    free(act_system);
+    cond_broadcast(&system_destroyed);
+    mutex_unlock(&systems_lock);
     debug(puts("System destroyed!"));
 }
 
-/* Worker threads behaviour */
-static void* worker(__attribute__((unused)) void *data) {
+/* Scheduling */
+
+/* Must be called with the node's mutex locked */
+static void global_queue_push(node_t *const node, size_t priority, actor_id_t actor) {
+    // Each actor is queued at most once and there are at most CAST_LIMIT of them.
+    if (actors_queue_push(&node->queues[priority], actor) != 0)
+        fatal("Global actors queue is full.");
+    atomic_fetch_add_explicit(&node->queue_sizes[priority], 1, memory_order_relaxed);
+}
+
+/* Must be called with the node's mutex locked */
+static actor_id_t global_queue_pop(node_t *const node, size_t priority) {
+    atomic_fetch_sub_explicit(&node->queue_sizes[priority], 1, memory_order_relaxed);
+    return actors_queue_pop(&node->queues[priority]);
+}
+
+/* Must be called with actor system mutex locked */
+static void unpark(struct actor_system *const sys, worker_t *const worker, bool spinning) {
+    worker_t **prev = &sys->idle_workers;
+    while (*prev != worker)
+        prev = &(*prev)->next_idle;
+    *prev = worker->next_idle;
+    worker->parked = false;
+    worker->wake_spinning = spinning;
+    atomic_fetch_sub(&sys->idle_threads, 1);
+}
+
+/* Must be called with actor system mutex locked */
+static void wake_all(struct actor_system *const sys) {
+    while (sys->idle_workers != NULL) {
+        worker_t *const worker = sys->idle_workers;
+        unpark(sys, worker, false);
+        sem_post(&worker->wakeup);
+    }
+}
+
+/* Wakes up a parked worker to look for new work, unless some worker
+ * is already looking for it. A worker of the given node is preferred. */
+static void wakep(struct actor_system *const sys, size_t node) {
     int err;
-    message_t message;
-    act_state_t *curr_act_config;
+    // pairs with the fence in park(), so that either the new work is seen
+    // by a worker going asleep or that worker is seen here
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&sys->spinning) != 0 || atomic_load(&sys->idle_threads) == 0)
+        return;
+    size_t none = 0;
+    if (!atomic_compare_exchange_strong(&sys->spinning, &none, 1))
+        return;
 
-    mutex_lock(&act_system->mutex);
-    ++act_system->alive_threads;
-    mutex_unlock(&act_system->mutex);
-    debug(printf("Thread %lu started!\n", pthread_self() % 100));
+    mutex_lock(&sys->mutex);
+    worker_t *worker = sys->idle_workers;
+    while (worker != NULL && worker->node != node)
+        worker = worker->next_idle;
+    if (worker == NULL)
+        worker = sys->idle_workers;
+    if (worker != NULL)
+        unpark(sys, worker, true); // counted as spinning already
+    mutex_unlock(&sys->mutex);
+
+    if (worker != NULL)
+        sem_post(&worker->wakeup);
+    else
+        atomic_fetch_sub(&sys->spinning, 1);
+}
 
-    while (true) {
-        // determine job
-        debug(printf("Thread %lu applies for a new job!\n", pthread_self() % 100));
-        mutex_lock(&act_system->mutex);
-
-        while (actors_queue_is_empty(&act_system->act_queue) && act_system->alive_actors > 0) {
-            debug(printf("Thread %lu went asleep.\n", pthread_self() % 100));
-            cond_wait(&act_system->new_request, &act_system->mutex);
-            debug(printf("Thread %lu woke up!\n", pthread_self() % 100));
+/* Moves half of the worker's full run queue of the priority, together with actor,
+ * to the global queue of the worker's node. */
+static void schedule_overflow(worker_t *const self, size_t priority, actor_id_t actor) {
+    int err;
+    node_t *const node = &self->system->nodes[self->node];
+    actor_id_t batch[RUN_QUEUE_CAPACITY / 2];
+    size_t n = run_queue_grab_half(&self->run_queues[priority], batch);
+
+    mutex_lock(&node->mutex);
+    for (size_t i = 0; i < n; ++i)
+        global_queue_push(node, priority, batch[i]);
+    global_queue_push(node, priority, actor);
+    mutex_unlock(&node->mutex);
+}
+
+/* Puts the actor at the back of the worker's run queue of the priority, or the global
+ * queue if the run queue is full. */
+static void local_push(worker_t *const self, size_t priority, actor_id_t actor) {
+    run_queue_t *const q = &self->run_queues[priority];
+    if (!run_queue_push(q, actor))
+        schedule_overflow(self, priority, actor);
+    stats(stat_max(&self->stats.run_queue_high_water, run_queue_size(q)));
+}
+
+/* Puts the actor in the worker's next slot, so that it runs right after the current one
+ * while its messages are still in the cache. The actor displaced from the slot goes
+ * to the back of the run queue. */
+static void push_next(worker_t *const self, actor_id_t actor) {
+    if (self->next_streak >= RUN_NEXT_LIMIT) {
+        local_push(self, CACTI_PRIORITY_NORMAL, actor);
+        return;
+    }
+    actor_id_t displaced = run_queue_swap_next(&self->run_queues[CACTI_PRIORITY_NORMAL], actor);
+    if (displaced != RUN_QUEUE_NONE)
+        local_push(self, CACTI_PRIORITY_NORMAL, displaced);
+}
+
+/* Node the actor is scheduled on if it is made runnable off its node */
+static size_t home_node(struct actor_system *const sys, actor_id_t actor) {
+    return sys->nnodes > 1 ? actor_state(sys, actor)->node : 0;
+}
+
+/* Makes the actors of the system runnable. Must be called once per transition of actor's
+ * mailbox from idle to non-empty. Workers of the system keep the actors of their node
+ * in their own run queues, the last one of normal priority in the next slot. Other actors
+ * and ones made runnable by other threads are handed over to the global queues
+ * of their node. */
+static void schedule_batch(struct actor_system *const sys, const actor_id_t *const actors,
+        size_t n) {
+    int err;
+    worker_t *const self = curr_worker != NULL && curr_worker->system == sys ? curr_worker : NULL;
+    node_t *locked = NULL;
+    actor_id_t next = RUN_QUEUE_NONE;
+    size_t wake_node = self != NULL ? self->node : home_node(sys, actors[0]);
+
+    trace(for (size_t i = 0; i < n; ++i) trace_event(sys, TRACE_SCHEDULE, actors[i], 0));
+    for (size_t i = 0; i < n; ++i) {
+        act_state_t *const state = actor_state(sys, actors[i]);
+        size_t home = sys->nnodes > 1 ? state->node : 0;
+        if (self != NULL && home == self->node) {
+            if (state->role.priority != CACTI_PRIORITY_NORMAL) {
+                local_push(self, state->role.priority, actors[i]);
+                continue;
+            }
+            if (next != RUN_QUEUE_NONE)
+                local_push(self, CACTI_PRIORITY_NORMAL, next);
+            next = actors[i];
+            continue;
+        }
+        if (locked != &sys->nodes[home]) {
+            if (locked != NULL)
+                mutex_unlock(&locked->mutex);
+            locked = &sys->nodes[home];
+            mutex_lock(&locked->mutex);
         }
-        if (actors_queue_is_empty(&act_system->act_queue) && act_system->alive_actors == 0) {
-            cond_signal(&act_system->new_request);
-            mutex_unlock(&act_system->mutex);
+        global_queue_push(locked, state->role.priority, actors[i]);
+        debug(printf("Pushed actor %li to actors queue of node %zu.\n", actors[i], home));
+    }
+    if (locked != NULL)
+        mutex_unlock(&locked->mutex);
+    if (next != RUN_QUEUE_NONE)
+        push_next(self, next);
+    // A single worker is woken up even for many actors - it wakes up the next one
+    // as soon as it finds work.
+    wakep(sys, wake_node);
+}
+
+static void schedule(struct actor_system *const sys, actor_id_t actor) {
+    schedule_batch(sys, &actor, 1);
+}
+
+/* Takes an actor from the global queue of the node and priority and moves a fair share
+ * of the rest to the worker's run queue. */
+static bool take_global_of(worker_t *const self, node_t *const node, size_t priority,
+        actor_id_t *const actor) {
+    int err;
+    actors_queue_t *const queue = &node->queues[priority];
+    if (atomic_load_explicit(&node->queue_sizes[priority], memory_order_relaxed) == 0)
+        return false;
+
+    mutex_lock(&node->mutex);
+    if (actors_queue_is_empty(queue)) {
+        mutex_unlock(&node->mutex);
+        return false;
+    }
+    *actor = global_queue_pop(node, priority);
+
+    size_t n = queue->size / node->nworkers;
+    if (n > RUN_QUEUE_CAPACITY / 2)
+        n = RUN_QUEUE_CAPACITY / 2;
+    for (size_t i = 0; i < n; ++i) {
+        actor_id_t next = global_queue_pop(node, priority);
+        if (!run_queue_push(&self->run_queues[priority], next)) {
+            global_queue_push(node, priority, next);
             break;
         }
-        assert(!actors_queue_is_empty(&act_system->act_queue));
-        curr_actor = actors_queue_pop(&act_system->act_queue);
-        mutex_unlock(&act_system->mutex);
-
-        // work on actor begins
-        debug(printf("Thread %lu began working on actor %ld!\n",
-                pthread_self() % 100, curr_actor));
-        rwlock_rdlock(&act_system->actors.rwlock);
-        curr_act_config = act_system->actors.arr[curr_actor];
-        rwlock_unlock(&act_system->actors.rwlock);
-
-        mutex_lock(&curr_act_config->mutex);
-        curr_act_config->worked_at = true;
-
-        // Loop in order to reduce resource waste on actor switch.
-        for (size_t i = 0; i < MAX_MESSAGES_PROCESSED_IN_ONE_ITERATION; ++i) {
-            assert(!message_queue_is_empty(&curr_act_config->queue));
-            message = message_queue_pop(&curr_act_config->queue);
-            mutex_unlock(&curr_act_config->mutex);
-
-            debug(printf("Thread %lu has started processing message of type %ld on actor %ld!\n",
-                         pthread_self() % 100, message.message_type,  curr_actor));
-            process_message(curr_actor, message);
-
-            debug(printf("Thread %lu has processed message of type %ld on actor %ld!\n",
-                    pthread_self() % 100, message.message_type,  curr_actor));
-            mutex_lock(&curr_act_config->mutex);
-
-            if (message_queue_is_empty(&curr_act_config->queue))
-                break; // There is nothing to do here in current actor.
+    }
+    mutex_unlock(&node->mutex);
+    return true;
+}
+
+/* Takes an actor from the global queues of the node, high priority first. */
+static bool take_global(worker_t *const self, node_t *const node, actor_id_t *const actor) {
+    for (size_t p = CACTI_PRIORITIES; p-- > 0;) {
+        if (take_global_of(self, node, p, actor))
+            return true;
+    }
+    return false;
+}
+
+/* Takes an actor from the worker's own run queues, high priority first. The next slot
+ * goes before the rest of the normal queue; *from_next tells if it was taken. */
+static bool take_local(worker_t *const self, bool *const from_next, actor_id_t *const actor) {
+    *from_next = false;
+    for (size_t p = CACTI_PRIORITIES; p-- > 0;) {
+        run_queue_t *const q = &self->run_queues[p];
+        if (p == CACTI_PRIORITY_NORMAL && (*from_next = run_queue_take_next(q, actor)))
+            return true;
+        if (run_queue_pop(q, actor))
+            return true;
+    }
+    return false;
+}
+
+/* The next slot of a victim is taken only if take_next is set, as its owner is likely
+ * to run that actor soon itself. */
+static bool steal(worker_t *const self, node_t *const node, bool take_next,
+        actor_id_t *const actor) {
+    size_t start = rand_r(&self->rand_state) % node->nworkers;
+    for (size_t i = 0; i < node->nworkers; ++i) {
+        worker_t *const victim = &node->workers[(start + i) % node->nworkers];
+        if (victim == self)
+            continue;
+        bool stolen = false;
+        for (size_t p = CACTI_PRIORITIES; p-- > 0 && !stolen;)
+            stolen = run_queue_steal(&victim->run_queues[p], &self->run_queues[p], actor);
+        if (!stolen && take_next)
+            stolen = run_queue_take_next(&victim->run_queues[CACTI_PRIORITY_NORMAL], actor);
+        if (stolen) {
+            stats(stat_add(&self->stats.steals, 1));
+            debug(printf("Thread %lu stole actor %ld from thread %lu!\n",
+                    self->id, *actor, victim->id));
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Looks for work of other workers, on the worker's own node first,
+ * as actors of other nodes keep their memory there. */
+static bool look_around(worker_t *const self, bool take_next, actor_id_t *const actor) {
+    struct actor_system *const sys = self->system;
+    for (size_t i = 0; i < sys->nnodes; ++i) {
+        node_t *const node = &sys->nodes[(self->node + i) % sys->nnodes];
+        if (steal(self, node, take_next, actor) || take_global(self, node, actor))
+            return true;
+    }
+    return false;
+}
+
+static bool any_work_visible(struct actor_system *const sys) {
+    for (size_t i = 0; i < sys->nnodes; ++i) {
+        for (size_t p = 0; p < CACTI_PRIORITIES; ++p) {
+            if (atomic_load(&sys->nodes[i].queue_sizes[p]) > 0)
+                return true;
+        }
+    }
+    for (size_t i = 0; i < sys->pool_size; ++i) {
+        run_queue_t *const queues = sys->workers[i].run_queues;
+        for (size_t p = 0; p < CACTI_PRIORITIES; ++p) {
+            if (!run_queue_is_empty(&queues[p]))
+                return true;
         }
-        if (!message_queue_is_empty(&curr_act_config->queue)) {
-            mutex_lock(&act_system->mutex);
-            assert(!actors_queue_is_full(&act_system->act_queue));
-            actors_queue_push(&act_system->act_queue, curr_actor);
-            mutex_unlock(&act_system->mutex);
+        if (run_queue_has_next(&queues[CACTI_PRIORITY_NORMAL]))
+            return true;
+    }
+    return false;
+}
+
+/* Returns false if the worker may not spin, as enough workers do that already. */
+static bool start_spinning(worker_t *const self) {
+    struct actor_system *const sys = self->system;
+    if (self->spinning)
+        return true;
+    if (sys->spin_rounds == 0)
+        return false;
+    size_t busy = sys->pool_size - atomic_load(&sys->idle_threads);
+    if (2 * atomic_load(&sys->spinning) >= busy)
+        return false;
+    atomic_fetch_add(&sys->spinning, 1);
+    self->spinning = true;
+    return true;
+}
+
+static void stop_spinning(worker_t *const self) {
+    if (!self->spinning)
+        return;
+    self->spinning = false;
+    // The work found may be only a part of what was published, so somebody
+    // has to keep looking for the rest.
+    if (atomic_fetch_sub(&self->system->spinning, 1) == 1)
+        wakep(self->system, self->node);
+}
+
+static void sem_wait_uninterrupted(sem_t *const sem) {
+    while (sem_wait(sem) != 0) {
+        if (errno != EINTR)
+            syserr(errno, "sem_wait failed");
+    }
+}
+
+/* Puts the worker asleep until there may be work for it.
+ * Returns false when the system has finished. */
+static bool park(worker_t *const self) {
+    int err;
+    struct actor_system *const sys = self->system;
+
+    mutex_lock(&sys->mutex);
+    self->parked = true;
+    self->next_idle = sys->idle_workers;
+    sys->idle_workers = self;
+    atomic_fetch_add(&sys->idle_threads, 1);
+    mutex_unlock(&sys->mutex);
+
+    if (self->spinning) {
+        self->spinning = false;
+        atomic_fetch_sub(&sys->spinning, 1);
+    }
+    // pairs with the fence in wakep(), so that either the work published
+    // before is seen here or this worker is seen parked there
+    atomic_thread_fence(memory_order_seq_cst);
+
+    bool work = any_work_visible(sys);
+    bool finished = !work && atomic_load(&sys->alive_actors) == 0;
+    if (work || finished) {
+        mutex_lock(&sys->mutex);
+        bool woken = !self->parked; // somebody has already posted the semaphore
+        if (!woken)
+            unpark(sys, self, false);
+        if (finished)
+            wake_all(sys); // let the others finish, too
+        mutex_unlock(&sys->mutex);
+        if (!woken)
+            return !finished;
+    }
+
+    debug(printf("Thread %lu went asleep.\n", self->id));
+    stats(stat_add(&self->stats.parks, 1));
+    trace(trace_event(sys, TRACE_PARK, 0, 0));
+    sem_wait_uninterrupted(&self->wakeup);
+    trace(trace_event(sys, TRACE_UNPARK, 0, 0));
+    debug(printf("Thread %lu woke up!\n", self->id));
+    self->spinning = self->wake_spinning;
+    return !finished;
+}
+
+/* Finds the next actor to work on. Returns false when the system has finished. */
+static bool find_work(worker_t *const self, actor_id_t *const actor) {
+    bool from_next = false;
+    while (true) {
+        // The global queue is checked from time to time even if there is local work,
+        // so that actors scheduled from outside the pool are not starved.
+        node_t *const node = &self->system->nodes[self->node];
+        if (++self->tick % GLOBAL_QUEUE_CHECK_INTERVAL == 0 && take_global(self, node, actor))
+            break;
+        if (take_local(self, &from_next, actor))
+            break;
+        if (take_global(self, node, actor))
+            break;
+
+        // New work usually comes soon, so it is waited for without a syscall for a while.
+        // Next slots of busy workers are left to them until the last round.
+        size_t rounds = start_spinning(self) ? self->system->spin_rounds : 1;
+        bool found = false;
+        for (size_t i = 0; i < rounds && !found; ++i)
+            found = look_around(self, i + 1 == rounds, actor);
+        if (found)
+            break;
+
+        // Payloads freed here are returned to their pools before going asleep.
+        msg_pool_flush();
+        if (!park(self))
+            return false;
+    }
+    self->next_streak = from_next ? self->next_streak + 1 : 0;
+    stop_spinning(self);
+    trace(trace_event(self->system, TRACE_DEQUEUE, *actor, 0));
+    return true;
+}
+
+static long now_ticks() {
+    return monotonic_nanos() / CACTI_TIMER_TICK;
+}
+
+/* Computes the number of messages the actor may process in this turn
+ * and the time limit of the turn (0 if there is none). */
+static size_t turn_budget(struct actor_system *const sys, act_state_t *const config,
+        long *const deadline) {
+    budget_t budget = config->role.budget;
+    if (budget.messages == 0)
+        budget.messages = atomic_load_explicit(&sys->budget_messages, memory_order_relaxed);
+    if (budget.nanos == 0)
+        budget.nanos = atomic_load_explicit(&sys->budget_nanos, memory_order_relaxed);
+
+    // An actor with a deep mailbox gets a longer turn, which saves it trips
+    // through the run queue. The turn stays bounded, so other actors do not starve.
+    size_t limit = budget.messages;
+    size_t waiting = mailbox_size(&config->mailbox);
+    if (waiting > limit)
+        limit = waiting < limit * BUDGET_MAX_SCALE ? waiting : limit * BUDGET_MAX_SCALE;
+
+    *deadline = budget.nanos > 0 ? monotonic_nanos() + budget.nanos : 0;
+    return limit;
+}
+
+/* Wakes up the senders waiting for room in the actor's mailbox, if there are any. */
+static void notify_room(struct actor_system *const sys, act_state_t *const state) {
+    int err;
+    // pairs with the fence in wait_for_room(), so that either the sender
+    // sees the room or it is seen waiting here
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&state->room_waiters, memory_order_relaxed) == 0)
+        return;
+    room_queue_t *const queue = room_queue_of(sys, state->id);
+    mutex_lock(&queue->mutex);
+    cond_broadcast(&queue->room);
+    mutex_unlock(&queue->mutex);
+}
+
+static void run_actor(worker_t *const self, actor_id_t actor) {
+    mailbox_node_t *node;
+    act_state_t *curr_act_config;
+    size_t processed = 0;
+    long deadline;
+
+    debug(printf("Thread %lu began working on actor %ld!\n", self->id, actor));
+    curr_act_config = actor_state(self->system, actor);
+
+    // Loop in order to reduce resource waste on actor switch.
+    size_t limit = turn_budget(self->system, curr_act_config, &deadline);
+    // A throttled actor ends its turn early, letting the receivers it overfilled catch up.
+    while (processed < limit && !self->throttled &&
+            (node = mailbox_pop(&curr_act_config->mailbox)) != NULL) {
+        debug(printf("Thread %lu has started processing message of type %ld on actor %ld!\n",
+                     self->id, node->message.message_type, actor));
+        stats(worker_stats_latency(&self->stats, monotonic_nanos() - node->enqueued));
+        trace(trace_event(self->system, TRACE_HANDLER_START, actor,
+                node->message.message_type));
+        process_message(self, curr_act_config, node->message);
+        trace(trace_event(self->system, TRACE_HANDLER_END, actor, 0));
+        ++processed;
+
+        debug(printf("Thread %lu has processed message of type %ld on actor %ld!\n",
+                self->id, node->message.message_type, actor));
+        mailbox_node_free(node);
+        if (deadline != 0 && monotonic_nanos() >= deadline)
+            break;
+    }
+    self->throttled = false;
+    stats(stat_add(&self->stats.messages_processed, processed));
+    stats(stat_add(&curr_act_config->processed, processed));
+
+    // Messages left in the mailbox (also ones still being pushed) make the actor
+    // go to the back of this worker's queue, so it is not starved and stays
+    // on the same thread unless stolen.
+    size_t left = mailbox_release(&curr_act_config->mailbox, processed);
+    if (left > 0)
+        local_push(self, curr_act_config->role.priority, actor);
+    // Any freed room may be enough for a waiting batch.
+    if (processed > 0)
+        notify_room(self->system, curr_act_config);
+}
+
+/* Worker threads behaviour */
+/* Waits until the finished system is reused. Returns false if it is retired instead. */
+static bool wait_for_reuse(worker_t *const self) {
+    int err;
+    sem_wait_uninterrupted(&self->wakeup);
+    mutex_lock(&self->system->mutex);
+    bool retired = self->system->retired;
+    mutex_unlock(&self->system->mutex);
+    return !retired;
+}
+
+/* A worker thread serves the systems run by its structure one after another,
+ * keeping its caches of mailbox nodes in between. */
+static void* worker(void *data) {
+    int err;
+    worker_t *const self = data;
+    struct actor_system *const sys = self->system;
+
+    do {
+        debug(printf("Thread %lu started!\n", self->id));
+        curr_worker = self;
+        while (find_work(self, &self->actor))
+            run_actor(self, self->actor);
+        curr_worker = NULL;
+
+        mutex_lock(&sys->mutex);
+        bool last = --sys->alive_threads == 0;
+        bool interrupted = sys->interrupted;
+        mutex_unlock(&sys->mutex);
+        if (last) {
+            system_finish(sys);
+            if (interrupted)
+                raise(SIGINT);
         }
-        curr_act_config->worked_at = false;
-        mutex_unlock(&curr_act_config->mutex);
-    }
-    mutex_lock(&act_system->mutex);
-    --act_system->alive_threads;
-    if (act_system->alive_threads == 0) {
-        bool interrupted = act_system->interrupted;
-        mutex_unlock(&act_system->mutex);
-        actor_system_destroy();
-        if (interrupted)
-            raise(SIGINT);
-    } else
-        mutex_unlock(&act_system->mutex);
-
-    debug(printf("Thread %lu finished!\n", pthread_self() % 100));
+        debug(printf("Thread %lu finished!\n", self->id));
+    } while (wait_for_reuse(self));
+
+    mutex_lock(&sys->mutex);
+    bool last = --sys->alive_threads == 0;
+    mutex_unlock(&sys->mutex);
+    if (last)
+        system_free(sys);
     return NULL;
 }
 
-/* SIGINT handler */
-static void interrupt() {
+static void interrupt_system(struct actor_system *const sys) {
     int err;
+    sys->interrupted = true;
+
+    // The flags are scanned without touching the states of the actors.
+    registry_flag_all(&sys->actors);
+
+    mutex_lock(&sys->mutex);
+    atomic_store(&sys->alive_actors, 0);
+    wake_all(sys);
+    mutex_unlock(&sys->mutex);
+}
+
+/* SIGINT handler - interrupts all the systems */
+static void interrupt() {
     debug(fputs("Interrupted!", stderr));
-    act_system->interrupted = true;
+    for (size_t slot = 0; slot < CACTI_MAX_SYSTEMS; ++slot) {
+        struct actor_system *const sys = atomic_load(&systems[slot]);
+        if (sys != NULL)
+            interrupt_system(sys);
+    }
+}
 
-    rwlock_wrlock(&act_system->actors.rwlock);
-    for (size_t i = 0; i < act_system->actors.size; ++i) {
-        act_system->actors.arr[i]->gone_die = true;
+/* Checks the configuration as given, before the defaults are filled in. */
+static int system_config_validate(const actor_system_config_t *const config) {
+    if (config->cpu_affinity != NULL) {
+        // the length of the array is not known otherwise
+        if (config->pool_size == 0)
+            return -1;
+        for (size_t i = 0; i < config->pool_size; ++i) {
+            if (config->cpu_affinity[i] < -1 || config->cpu_affinity[i] >= CPU_SETSIZE)
+                return -1;
+        }
     }
-    rwlock_unlock(&act_system->actors.rwlock);
+    if (config->stack_size != 0 && config->stack_size < (size_t)PTHREAD_STACK_MIN)
+        return -1;
+    return 0;
+}
 
-    mutex_lock(&act_system->mutex);
-    act_system->alive_actors = 0;
-    cond_broadcast(&act_system->new_request);
-    mutex_unlock(&act_system->mutex);
+/* Makes timed waits on the condition variable use CLOCK_MONOTONIC. */
+static int monotonic_cond_init(pthread_cond_t *const cond) {
+    pthread_condattr_t attr;
+    if (pthread_condattr_init(&attr) != 0)
+        return -1;
+    int result = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) == 0 &&
+            pthread_cond_init(cond, &attr) == 0 ? 0 : -1;
+    pthread_condattr_destroy(&attr);
+    return result;
 }
 
-int actor_system_create(actor_id_t *leader, role_t *const role) {
-    int err;
-    if (act_system != NULL)
+/* A worker is pinned to the CPU given in config or, if node_cpus is not NULL,
+ * to the CPUs of its node. */
+static int worker_attr_init(pthread_attr_t *const attr, const actor_system_config_t *const config,
+        size_t worker_id, const cpu_set_t *const node_cpus) {
+    if (pthread_attr_init(attr) != 0)
         return -1;
-    if ((act_system = malloc(sizeof(struct actor_system))) == NULL)
+    // Workers are never joined - actor_system_join waits for the system to be destroyed.
+    if (pthread_attr_setdetachstate(attr, PTHREAD_CREATE_DETACHED) != 0)
+        goto FAILED;
+    if (config->stack_size != 0 && pthread_attr_setstacksize(attr, config->stack_size) != 0)
+        goto FAILED;
+    if (config->cpu_affinity != NULL && config->cpu_affinity[worker_id] >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(config->cpu_affinity[worker_id], &cpus);
+        if (pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), &cpus) != 0)
+            goto FAILED;
+    } else if (node_cpus != NULL &&
+            pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), node_cpus) != 0)
+        goto FAILED;
+    return 0;
+
+    FAILED:
+    pthread_attr_destroy(attr);
+    return -1;
+}
+
+/* Returns a free slot for a new system, or -1 if there is none.
+ * Must be called with systems_lock locked. */
+static long free_slot(bool is_default) {
+    if (is_default)
+        return atomic_load(&systems[0]) == NULL ? 0 : -1;
+    for (size_t slot = 1; slot < CACTI_MAX_SYSTEMS; ++slot) {
+        if (atomic_load(&systems[slot]) == NULL)
+            return (long)slot;
+    }
+    return -1;
+}
+
+static void io_done(io_request_t *const request); // see File I/O
+
+/* Allocates a system of the given shape, whose threads are not started yet.
+ * Returns NULL on failure. Must be called with systems_lock locked. */
+static struct actor_system *system_alloc(const actor_system_config_t *const conf,
+        size_t nnodes, bool bind) {
+    int err;
+    struct actor_system *sys;
+    if ((sys = aligned_alloc(CACHE_LINE_SIZE, sizeof(struct actor_system))) == NULL)
         goto MAIN_MALLOC_FAILED;
-    if (act_state_arr_init(&act_system->actors) != 0)
-        goto ACT_STATE_ARR_INIT_FAILED;
-    if (act_state_arr_emplace(&act_system->actors, role, 0) != 0)
-        goto ACT_STATE_INIT_FAILED;
-    if (actors_queue_init(&act_system->act_queue, CAST_LIMIT) != 0)
-        goto ACTOR_QUEUE_INIT_FAILED;
-    if (pthread_mutex_init(&act_system->mutex, NULL) != 0)
+    if ((sys->workers = aligned_alloc(CACHE_LINE_SIZE, conf->pool_size * sizeof(worker_t)))
+            == NULL)
+        goto WORKERS_MALLOC_FAILED;
+    if (registry_init(&sys->actors, conf->actors_capacity) != 0)
+        goto REGISTRY_INIT_FAILED;
+    if ((sys->nodes = nodes_new(sys->workers, conf->pool_size, nnodes)) == NULL)
+        goto NODES_INIT_FAILED;
+    sys->nnodes = nnodes;
+    if (pthread_mutex_init(&sys->mutex, NULL) != 0)
         goto MUTEX_INIT_FAILED;
-    if (pthread_cond_init(&act_system->new_request, NULL) != 0)
-        goto NEW_REQUEST_INIT_FAILED;
+    if (room_queues_init(sys->room_queues, ROOM_QUEUES) != 0)
+        goto ROOM_QUEUES_INIT_FAILED;
+    if (pthread_mutex_init(&sys->timer_mutex, NULL) != 0)
+        goto TIMER_MUTEX_INIT_FAILED;
+    if (monotonic_cond_init(&sys->timer_cond) != 0)
+        goto TIMER_COND_INIT_FAILED;
+    if (io_service_init(&sys->io, io_done, conf->io_threads, !conf->io_uring_disabled) != 0)
+        goto IO_SERVICE_INIT_FAILED;
+
+    sys->generation = 0;
+    sys->pool_size = conf->pool_size;
+    sys->stack_size = conf->stack_size;
+    sys->bound = bind;
+    sys->pinned = conf->cpu_affinity != NULL;
+    sys->retired = false;
+    sys->spin_rounds = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_ROUNDS : 0;
+    timer_wheel_init(&sys->timers, now_ticks());
+#ifdef CACTI_TRACE
+    if ((sys->outside_trace = trace_ring_new(true)) == NULL)
+        fatal("malloc failed");
+    sys->trace_path = NULL;
+#endif
+    for (size_t i = 0; i < conf->pool_size; ++i) {
+        sys->workers[i].system = sys;
+        sys->workers[i].id = i;
+        if (sem_init(&sys->workers[i].wakeup, 0, 0) != 0)
+            fatal("sem_init failed");
+        slab_allocator_init(&sys->workers[i].act_states, sizeof(act_state_t),
+                bind ? machine.ids[sys->workers[i].node] : -1);
+        for (size_t p = 0; p < CACTI_PRIORITIES; ++p)
+            run_queue_init(&sys->workers[i].run_queues[p]);
+#ifdef CACTI_TRACE
+        if ((sys->workers[i].trace = trace_ring_new(false)) == NULL)
+            fatal("malloc failed");
+#endif
+    }
+    return sys;
 
-    act_system->alive_actors = 1;
-    act_system->interrupted = false;
-    act_system->alive_threads = POOL_SIZE;
-    *leader = 0;
+    // Rollback in case of failure
+    IO_SERVICE_INIT_FAILED:
+    cond_destroy(&sys->timer_cond);
+    TIMER_COND_INIT_FAILED:
+    mutex_destroy(&sys->timer_mutex);
+    TIMER_MUTEX_INIT_FAILED:
+    room_queues_destroy(sys->room_queues, ROOM_QUEUES);
+    ROOM_QUEUES_INIT_FAILED:
+    mutex_destroy(&sys->mutex);
+    MUTEX_INIT_FAILED:
+    nodes_destroy(sys->nodes, sys->nnodes);
+    NODES_INIT_FAILED:
+    registry_destroy(&sys->actors);
+    REGISTRY_INIT_FAILED:
+    free(sys->workers);
+    WORKERS_MALLOC_FAILED:
+    free(sys);
+    MAIN_MALLOC_FAILED:
+    return NULL;
+}
+
+/* Brings a spare system back to the state of a new one. Its memory, threads and
+ * io_uring ring are kept, so only what a finished system leaves behind is reset. */
+static void system_reset(struct actor_system *const sys, const actor_system_config_t *const conf) {
+    timer_wheel_destroy(&sys->timers);
+    timer_wheel_init(&sys->timers, now_ticks());
+    io_service_reset(&sys->io, conf->io_threads, !conf->io_uring_disabled);
+#ifdef CACTI_TRACE
+    atomic_store(&sys->outside_trace->next, 0);
+    for (size_t i = 0; i < sys->pool_size; ++i)
+        atomic_store(&sys->workers[i].trace->next, 0);
+#endif
+}
+
+/* Creates the default system, which takes slot 0, or another one, which gets
+ * a handle. Returns -1 if the configuration is invalid or there is no free slot.
+ * A spare system of the same shape is reused, if there is one. */
+static int system_create(struct actor_system **const handle, actor_id_t *leader,
+        role_t *const role, const actor_system_config_t *config) {
+    int err;
+    struct actor_system *sys;
+    actor_system_config_t conf = config != NULL ? *config : (actor_system_config_t){0};
+    if (system_config_validate(&conf) != 0)
+        return -1;
+    if (conf.pool_size == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        conf.pool_size = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (conf.actors_capacity == 0)
+        conf.actors_capacity = INITIAL_ACTORS_CAPACITY;
+    if (conf.budget.messages == 0)
+        conf.budget.messages = BUDGET_MESSAGES;
+    if (conf.io_threads == 0)
+        conf.io_threads = CACTI_IO_THREADS;
+
+    mutex_lock(&systems_lock);
+    long slot = free_slot(handle == NULL);
+    if (slot < 0) {
+        mutex_unlock(&systems_lock);
+        return -1;
+    }
+    if (!machine_detected) {
+        topology_detect(&machine);
+        machine_detected = true;
+    }
+    // Simulated nodes group workers, but bind neither threads nor memory.
+    bool bind = conf.numa_nodes == 0 && machine.nnodes > 1;
+    size_t nnodes = conf.numa_nodes != 0 ? conf.numa_nodes : machine.nnodes;
+    if (nnodes > conf.pool_size)
+        nnodes = conf.pool_size;
+
+    bool reused = conf.cpu_affinity == NULL &&
+            (sys = system_reuse(conf.pool_size, conf.stack_size, nnodes, bind)) != NULL;
+    if (reused)
+        system_reset(sys, &conf);
+    else if ((sys = system_alloc(&conf, nnodes, bind)) == NULL) {
+        mutex_unlock(&systems_lock);
+        return -1;
+    }
+
+    sys->slot = (size_t)slot;
+    sys->has_handle = handle != NULL;
+    sys->finished = false;
+    ++sys->generation;
+    atomic_init(&sys->alive_actors, 0);
+    sys->interrupted = false;
+    atomic_init(&sys->budget_messages, conf.budget.messages);
+    atomic_init(&sys->budget_nanos, conf.budget.nanos);
+    sys->alive_threads = conf.pool_size;
+    sys->idle_workers = NULL;
+    atomic_init(&sys->idle_threads, 0);
+    atomic_init(&sys->spinning, 0);
+#ifdef CACTI_TRACE
+    trace_epoch_init(&sys->trace_epoch);
+    if (conf.trace_path != NULL && (sys->trace_path = strdup(conf.trace_path)) == NULL)
+        fatal("strdup failed");
+#endif
+    sys->timer_started = false;
+    sys->timer_stop = false;
+    sys->timer_wake = -1;
+    sys->futures = NULL;
+    stats(atomic_init(&sys->sent_outside, 0));
+    for (size_t i = 0; i < conf.pool_size; ++i) {
+        sys->workers[i].rand_state = i + 1;
+        sys->workers[i].tick = 0;
+        sys->workers[i].next_streak = 0;
+        sys->workers[i].throttled = false;
+        sys->workers[i].spinning = false;
+        sys->workers[i].parked = false;
+        stats(worker_stats_init(&sys->workers[i].stats));
+    }
+    spawn_actor(sys, leader, role);
+    atomic_store_explicit(&systems[slot], sys, memory_order_release);
     debug(puts("System created!"));
 
-    // Setting up signal handling
-    struct sigaction sigact;
-    sigset_t block_mask;
-    sigemptyset(&block_mask);
-    sigact.sa_handler = interrupt;
-    sigact.sa_mask = block_mask;
-    sigact.sa_flags = SA_RESTART;
-    sigaction(SIGINT, &sigact, &act_system->old_sigact);
+    // Setting up signal handling, shared by all the systems
+    if (running_systems++ == 0) {
+        struct sigaction sigact;
+        sigset_t block_mask;
+        sigemptyset(&block_mask);
+        sigact.sa_handler = interrupt;
+        sigact.sa_mask = block_mask;
+        sigact.sa_flags = SA_RESTART;
+        sigaction(SIGINT, &sigact, &old_sigact);
+    }
 
-    // Starting threads
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    for (size_t i = 0; i < POOL_SIZE; ++i) {
-        pthread_create(&act_system->pool[i], &attr, worker, NULL);
+    // Starting threads, or waking up the ones waiting for another system
+    for (size_t i = 0; i < conf.pool_size; ++i) {
+        if (reused) {
+            if (sem_post(&sys->workers[i].wakeup) != 0)
+                syserr(errno, "sem_post failed");
+            continue;
+        }
+        pthread_attr_t attr;
+        if (worker_attr_init(&attr, &conf, i,
+                bind ? &machine.cpus[sys->workers[i].node] : NULL) != 0)
+            fatal("Failed to set up worker thread attributes");
+        verify(pthread_create(&sys->workers[i].thread, &attr, worker,
+                &sys->workers[i]), "pthread_create failed");
+        pthread_attr_destroy(&attr);
     }
 
+    if (handle != NULL)
+        *handle = sys;
+    mutex_unlock(&systems_lock);
     debug(puts("All threads created!"));
     return 0;
+}
 
-    // Rollback in case of failure
-    NEW_REQUEST_INIT_FAILED:
-    mutex_destroy(&act_system->mutex);
-    MUTEX_INIT_FAILED:
-    actors_queue_destroy(&act_system->act_queue);
-    ACTOR_QUEUE_INIT_FAILED:
-    ACT_STATE_INIT_FAILED:
-    act_state_arr_destroy(&act_system->actors);
-    ACT_STATE_ARR_INIT_FAILED:
-    free(act_system);
-    MAIN_MALLOC_FAILED:
-    return -1;
+int actor_system_create(actor_id_t *leader, role_t *const role) {
+    return actor_system_create_ex(leader, role,
+            &(actor_system_config_t){.pool_size = POOL_SIZE});
+}
+
+int actor_system_create_ex(actor_id_t *leader, role_t *const role,
+        const actor_system_config_t *config) {
+    return system_create(NULL, leader, role, config);
+}
+
+int actor_system_new(actor_system_t **system, actor_id_t *leader, role_t *const role,
+        const actor_system_config_t *config) {
+    return system_create(system, leader, role, config);
+}
+
+void actor_system_wait(actor_system_t *system) {
+    int err;
+
+    mutex_lock(&systems_lock);
+    while (!system->finished)
+        cond_wait(&system_destroyed, &systems_lock);
+    system_recycle(system);
+    mutex_unlock(&systems_lock);
+}
+
+int actor_system_set_budget(actor_id_t actor, budget_t budget) {
+    struct actor_system *const sys = system_of(actor);
+    if (sys == NULL || actor_state(sys, actor) == NULL)
+        return -2; // no such actor
+    atomic_store(&sys->budget_messages,
+            budget.messages != 0 ? budget.messages : BUDGET_MESSAGES);
+    atomic_store(&sys->budget_nanos, budget.nanos);
+    return 0;
 }
 
 actor_id_t actor_id_self() {
-    return curr_actor;
+    return curr_worker != NULL ? curr_worker->actor : -1;
 }
 
 void actor_system_join(actor_id_t actor) {
     int err;
-    pthread_t pool_copy[POOL_SIZE];
 
-    if (act_system == NULL)
-        return;
+    mutex_lock(&systems_lock);
+    struct actor_system *const joined = system_of(actor);
+    if (joined != NULL) {
+        bool exists = actor_state(joined, actor) != NULL;
+        unsigned long generation = joined->generation;
 
-    if (actor >= 0 && actor < (actor_id_t)act_system->actors.size) {
-        // Copying pool array data in order to avoid segmentation fault in case of SIGINT.
-        for (size_t i = 0; i < POOL_SIZE; ++i) {
-            pool_copy[i] = act_system->pool[i];
-        }
+        // The system is destroyed by its last worker thread. Its structure may run
+        // another system by the time this thread wakes up.
+        while (exists && system_of(actor) == joined && joined->generation == generation)
+            cond_wait(&system_destroyed, &systems_lock);
+    }
+    mutex_unlock(&systems_lock);
+}
+
+/* Returns the state of the actor if it accepts messages and sets *sys to its system.
+ * Otherwise returns NULL and sets *result to the value send_message returns in such
+ * a case. */
+static act_state_t *receiver(actor_id_t actor, struct actor_system **const sys,
+        int *const result) {
+    act_state_t *target = (*sys = system_of(actor)) != NULL ? actor_state(*sys, actor) : NULL;
+    if (target == NULL) {
+        *result = -2; // no such target
+        return NULL;
+    }
+    if (atomic_load_explicit(target->gone_die, memory_order_relaxed)) {
+        *result = -1; // target does not accept new messages
+        return NULL;
+    }
+    return target;
+}
 
-        // Waiting for each thread in pool to finish.
-        for (size_t i = 0; i < POOL_SIZE; ++i)
-            verify(pthread_join(pool_copy[i], NULL), "join failed");
+static int push(act_state_t *const target, size_t lane, const message_t *const msgs, size_t n,
+        const void *const payload, bool overflow, bool *const was_empty) {
+    if (n == 1)
+        return mailbox_push(&target->mailbox, lane, msgs[0], payload, overflow, was_empty);
+    return mailbox_push_batch(&target->mailbox, lane, msgs, n, overflow, was_empty);
+}
+
+/* Blocks a thread outside of the pool until the messages fit in the mailbox. */
+static int wait_for_room(struct actor_system *const sys, act_state_t *const target,
+        const message_t *const msgs, size_t n, const void *const payload,
+        bool *const was_empty) {
+    int err;
+    int result;
+    room_queue_t *const queue = room_queue_of(sys, target->id);
+
+    mutex_lock(&queue->mutex);
+    ++queue->waiters;
+    atomic_fetch_add(&target->room_waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (true) {
+        if (atomic_load_explicit(target->gone_die, memory_order_relaxed)) {
+            result = -1;
+            break;
+        }
+        if ((result = push(target, MAILBOX_NORMAL, msgs, n, payload, false, was_empty)) == 0)
+            break;
+        cond_wait(&queue->room, &queue->mutex);
     }
+    atomic_fetch_sub(&target->room_waiters, 1);
+    --queue->waiters;
+    if (result != 0)
+        cond_broadcast(&queue->room); // the system may be waiting to end
+    mutex_unlock(&queue->mutex);
+    return result;
+}
+
+#ifdef CACTI_STATS
+/* Messages are counted by the sending worker, whichever system it runs,
+ * or by the receivers' system if they come from outside of any pool. */
+static void count_sent(struct actor_system *const sys, size_t n) {
+    if (curr_worker != NULL)
+        stat_add(&curr_worker->stats.messages_sent, n);
+    else
+        atomic_fetch_add_explicit(&sys->sent_outside, n, memory_order_relaxed);
+}
+#endif
+
+/* What a send does if the mailbox is full */
+typedef enum {
+    SEND_WAIT, // a handler overfills the mailbox, a thread outside of the pool waits for room
+    SEND_TRY, // returns -3
+    SEND_FORCE, // overfills the mailbox
+} send_mode_t;
+
+/* Puts the messages in the given lane of the target's mailbox. The control lane takes
+ * them even if the mailbox is full, otherwise it depends on the mode. A handler which
+ * overfills the mailbox is throttled. */
+static int deliver(struct actor_system *const sys, act_state_t *const target, size_t lane,
+        const message_t *const msgs, size_t n, const void *const payload, send_mode_t mode,
+        bool *const was_empty) {
+    worker_t *const self = curr_worker;
+    bool control = lane == MAILBOX_CONTROL;
+    int result = push(target, lane, msgs, n, payload,
+            control || mode == SEND_FORCE || (mode == SEND_WAIT && self != NULL), was_empty);
+
+    if (result > 0 && !control && self != NULL)
+        self->throttled = true;
+    if (result >= 0)
+        return 0;
+    if (mode == SEND_TRY || n > target->mailbox.limit)
+        return -3; // mailbox is full
+    return wait_for_room(sys, target, msgs, n, payload, was_empty);
+}
+
+static int send(actor_id_t actor, size_t lane, const message_t *const msgs, size_t n,
+        const void *const payload, send_mode_t mode) {
+    int result;
+    struct actor_system *sys;
+    act_state_t *target = receiver(actor, &sys, &result);
+    if (target == NULL)
+        return result;
+    if (n == 0)
+        return 0;
+
+    debug(printf("Sending %zu messages of type %li to actor %li...\n",
+            n, msgs[0].message_type, actor));
+
+    bool was_empty;
+    if ((result = deliver(sys, target, lane, msgs, n, payload, mode, &was_empty)) != 0)
+        return result;
+    stats(count_sent(sys, n));
+    trace(trace_event(sys, TRACE_SEND, actor, msgs[0].message_type));
+
+    debug(printf("Sent message to actor %li.\n", actor));
+
+    // If the actor queue was empty, it is required to schedule the actor.
+    if (was_empty)
+        schedule(sys, actor);
+    return 0;
 }
 
 int send_message(actor_id_t actor, message_t message) {
+    return send(actor, MAILBOX_NORMAL, &message, 1, NULL, SEND_WAIT);
+}
+
+int send_message_urgent(actor_id_t actor, message_t message) {
+    return send(actor, MAILBOX_CONTROL, &message, 1, NULL, SEND_WAIT);
+}
+
+int try_send_message(actor_id_t actor, message_t message) {
+    return send(actor, MAILBOX_NORMAL, &message, 1, NULL, SEND_TRY);
+}
+
+int send_message_inline(actor_id_t actor, message_type_t message_type,
+        const void *data, size_t nbytes) {
+    if (nbytes > INLINE_PAYLOAD_LIMIT)
+        fatal("Payload of %zu bytes is too big to be sent inline.", nbytes);
+    return send(actor, MAILBOX_NORMAL,
+            &(message_t){.message_type = message_type, .nbytes = nbytes}, 1, data, SEND_WAIT);
+}
+
+int send_messages(actor_id_t actor, const message_t *msgs, size_t n) {
+    return send(actor, MAILBOX_NORMAL, msgs, n, NULL, SEND_WAIT);
+}
+
+/* Sends the message, carrying a copy of the payload if it is not NULL, to each of n
+ * targets and stores the number of targets which got it in *delivered. */
+static int multicast(const actor_id_t *const targets, size_t n, message_t msg,
+        const void *const payload, size_t *const delivered) {
+    int result = 0;
+    struct actor_system *batch_system = NULL;
+    actor_id_t runnable[MULTICAST_SCHEDULE_BATCH];
+    size_t nrunnable = 0;
+
+    // Targets which become runnable are scheduled together, so that the run queue
+    // or the global queue is visited once per batch instead of once per target.
+    // A batch holds actors of one system.
+    for (size_t i = 0; i < n; ++i) {
+        int res;
+        struct actor_system *sys;
+        act_state_t *target = receiver(targets[i], &sys, &res);
+        if (target == NULL) {
+            result = res;
+            continue;
+        }
+        if (sys != batch_system && nrunnable > 0) {
+            schedule_batch(batch_system, runnable, nrunnable);
+            nrunnable = 0;
+        }
+        batch_system = sys;
+
+        bool was_empty;
+        if ((res = deliver(sys, target, MAILBOX_NORMAL, &msg, 1, payload,
+                curr_worker == NULL ? SEND_TRY : SEND_WAIT, &was_empty)) == -3) {
+            // The receivers found so far must not wait for a blocked sender.
+            if (nrunnable > 0)
+                schedule_batch(sys, runnable, nrunnable);
+            nrunnable = 0;
+            res = deliver(sys, target, MAILBOX_NORMAL, &msg, 1, payload, SEND_WAIT, &was_empty);
+        }
+        if (res != 0) {
+            result = res;
+            continue;
+        }
+        ++*delivered;
+        stats(count_sent(sys, 1));
+        trace(trace_event(sys, TRACE_SEND, targets[i], msg.message_type));
+        if (was_empty) {
+            runnable[nrunnable++] = targets[i];
+            if (nrunnable == MULTICAST_SCHEDULE_BATCH) {
+                schedule_batch(sys, runnable, nrunnable);
+                nrunnable = 0;
+            }
+        }
+    }
+    if (nrunnable > 0)
+        schedule_batch(batch_system, runnable, nrunnable);
+    return result;
+}
+
+int send_multicast(const actor_id_t *targets, size_t n, message_t msg) {
+    size_t delivered = 0;
+    return multicast(targets, n, msg, NULL, &delivered);
+}
+
+/* The receivers share the payload, each message carries only a pointer to it. */
+int send_shared(const actor_id_t *targets, size_t n, message_type_t message_type, void *data) {
+    shared_message_t shared = {.message_type = message_type, .data = data};
+    message_t msg = {.message_type = MSG_SHARED, .nbytes = sizeof(shared)};
+    // References are taken for all the targets at once, the caller's one keeps
+    // the payload alive meanwhile.
+    size_t delivered = 0;
+    atomic_fetch_add_explicit(&shared_of(data)->refs, n, memory_order_relaxed);
+    int result = multicast(targets, n, msg, &shared, &delivered);
+    if (delivered < n)
+        atomic_fetch_sub_explicit(&shared_of(data)->refs, n - delivered, memory_order_relaxed);
+    return result;
+}
+
+int send_request(actor_id_t actor, message_type_t message_type, void *data,
+        cacti_future_t **future) {
     int err;
-    if (actor >= (actor_id_t)act_system->actors.size)
-        return -2; // no such target
+    int result;
+    struct actor_system *sys;
+    if (receiver(actor, &sys, &result) == NULL)
+        return result;
 
-    // Fetching pointer to target actor
-    rwlock_rdlock(&act_system->actors.rwlock);
-    act_state_t *target = act_system->actors.arr[actor];
-    rwlock_unlock(&act_system->actors.rwlock);
+    cacti_future_t *f = malloc(sizeof(cacti_future_t));
+    if (f == NULL)
+        fatal("malloc failed");
+    atomic_init(&f->state, FUTURE_PENDING);
+    atomic_init(&f->refs, 2);
+    f->slot = sys->slot;
+    if (sem_init(&f->ready, 0, 0) != 0)
+        fatal("sem_init failed");
+
+    mutex_lock(&futures_locks[f->slot]);
+    // a system which is still in its slot has not broken its futures yet
+    if (system_of(actor) != sys) {
+        mutex_unlock(&futures_locks[f->slot]);
+        sem_destroy(&f->ready);
+        free(f);
+        return -2;
+    }
+    f->prev_next = &sys->futures;
+    f->next = sys->futures;
+    if (f->next != NULL)
+        f->next->prev_next = &f->next;
+    sys->futures = f;
+    mutex_unlock(&futures_locks[f->slot]);
+
+    cacti_request_t request = {.data = data, .future = f};
+    result = send(actor, MAILBOX_NORMAL, &(message_t){.message_type = message_type,
+            .nbytes = sizeof(request)}, 1, &request, SEND_WAIT);
+    if (result != 0) {
+        // nobody is going to reply
+        mutex_lock(&futures_locks[f->slot]);
+        if (atomic_load_explicit(&f->state, memory_order_relaxed) == FUTURE_PENDING)
+            future_complete(f, FUTURE_BROKEN, NULL);
+        mutex_unlock(&futures_locks[f->slot]);
+        future_release(f);
+        return result;
+    }
+    *future = f;
+    return 0;
+}
 
-    if (target->gone_die)
-        return -1; // target does not accept new messages
+void cacti_reply(cacti_future_t *future, void *result) {
+    int err;
+    size_t slot = future->slot; // the future may be gone once completed
+    mutex_lock(&futures_locks[slot]);
+    if (atomic_load_explicit(&future->state, memory_order_relaxed) == FUTURE_PENDING)
+        future_complete(future, FUTURE_READY, result);
+    mutex_unlock(&futures_locks[slot]);
+}
 
-    debug(printf("Sending message of type %li to actor %li...\n", message.message_type, actor));
+int cacti_future_poll(cacti_future_t *future, void **result) {
+    switch (atomic_load_explicit(&future->state, memory_order_acquire)) {
+        case FUTURE_PENDING:
+            return 1;
+        case FUTURE_READY:
+            *result = future->result;
+            return 0;
+        default:
+            return -1;
+    }
+}
 
-    mutex_lock(&target->mutex);
-    bool was_empty = !target->worked_at &&
-            message_queue_is_empty(&target->queue);
+int cacti_future_wait(cacti_future_t *future, void **result) {
+    if (atomic_load_explicit(&future->state, memory_order_acquire) == FUTURE_PENDING)
+        sem_wait_uninterrupted(&future->ready);
+    return cacti_future_poll(future, result);
+}
 
-    assert(!message_queue_is_full(&target->queue));
-    message_queue_push(&target->queue, message);
+void cacti_future_free(cacti_future_t *future) {
+    future_release(future);
+}
 
-    mutex_unlock(&target->mutex);
+/* Timers */
 
-    debug(printf("Sent message to actor %li.\n", actor));
+/* Sends the messages of due timers. Sending never blocks: a message which finds
+ * the mailbox full is tried again in the next tick. */
+static void *timer_main(void *data) {
+    int err;
+    struct actor_system *const sys = data;
+    timer_wheel_t *const w = &sys->timers;
+
+    mutex_lock(&sys->timer_mutex);
+    while (!sys->timer_stop) {
+        size_t index = timer_wheel_pop_due(w, now_ticks());
+        if (index != TIMER_NONE) {
+            timer_entry_t timer = w->entries[index];
+            mutex_unlock(&sys->timer_mutex);
+            int result = send(timer.actor, MAILBOX_NORMAL, &timer.message, 1, NULL, SEND_TRY);
+            mutex_lock(&sys->timer_mutex);
+
+            long deadline = -1;
+            if (result == -3)
+                deadline = w->now + 1;
+            else if (result == 0 && timer.period > 0)
+                deadline = timer.deadline + timer.period;
+            // periods missed by a late timer thread are skipped
+            if (deadline >= 0 && deadline < w->now)
+                deadline = w->now;
+            timer_wheel_fired(w, index, deadline);
+            continue;
+        }
+
+        sys->timer_wake = timer_wheel_next(w);
+        if (sys->timer_wake < 0) {
+            cond_wait(&sys->timer_cond, &sys->timer_mutex);
+            continue;
+        }
+        long wake = sys->timer_wake * CACTI_TIMER_TICK;
+        struct timespec ts = {.tv_sec = wake / 1000000000L, .tv_nsec = wake % 1000000000L};
+        err = pthread_cond_timedwait(&sys->timer_cond, &sys->timer_mutex, &ts);
+        if (err != 0 && err != ETIMEDOUT)
+            syserr(err, "cond timedwait failed");
+    }
+    mutex_unlock(&sys->timer_mutex);
+    return NULL;
+}
+
+/* Rounds nanoseconds up to ticks, so that timers never fire early. */
+static long ticks_of(long nanos) {
+    return nanos > 0 ? (nanos + CACTI_TIMER_TICK - 1) / CACTI_TIMER_TICK : 0;
+}
 
-    // If the actor queue was empty, it is required to push the actor id
-    // to the actors queue and notify one worker thread.
-    if (was_empty) {
-        mutex_lock(&act_system->mutex);
-        assert(!actors_queue_is_full(&act_system->act_queue));
-        actors_queue_push(&act_system->act_queue, actor);
+int cacti_timer_start(cacti_timer_t *timer, actor_id_t actor, message_t message, long delay,
+        long period) {
+    int err;
+    int result;
+    struct actor_system *sys;
+    if (receiver(actor, &sys, &result) == NULL)
+        return result;
+
+    long deadline = ticks_of(monotonic_nanos() + (delay > 0 ? delay : 0));
+    mutex_lock(&sys->timer_mutex);
+    if (sys->timer_stop) {
+        mutex_unlock(&sys->timer_mutex);
+        return -2; // the system is ending
+    }
+    if (!sys->timer_started) {
+        verify(pthread_create(&sys->timer_thread, NULL, timer_main, sys),
+                "pthread_create failed");
+        sys->timer_started = true;
+    }
+    unsigned generation;
+    size_t index = timer_wheel_add(&sys->timers, deadline, ticks_of(period), actor, message,
+            &generation);
+    if (sys->timer_wake < 0 || deadline < sys->timer_wake)
+        cond_signal(&sys->timer_cond);
+    mutex_unlock(&sys->timer_mutex);
+
+    if (timer != NULL)
+        *timer = (cacti_timer_t){.actor = actor, .id = (unsigned long)generation << 32 | index};
+    return 0;
+}
 
-        debug(printf("Pushed actor %li to actors queue.\n", actor));
+int send_message_after(actor_id_t actor, message_t message, long delay) {
+    return cacti_timer_start(NULL, actor, message, delay, 0);
+}
+
+int cacti_timer_cancel(cacti_timer_t timer) {
+    int err;
+    struct actor_system *const sys = system_of(timer.actor);
+    if (sys == NULL)
+        return -1;
+    mutex_lock(&sys->timer_mutex);
+    bool cancelled = timer_wheel_cancel(&sys->timers, timer.id & 0xffffffffUL,
+            (unsigned)(timer.id >> 32));
+    mutex_unlock(&sys->timer_mutex);
+    return cancelled ? 0 : -1;
+}
+
+/* File I/O */
+
+_Static_assert(sizeof(cacti_io_result_t) <= INLINE_PAYLOAD_LIMIT, "I/O results are sent inline");
+
+/* Reports the result of a request. The reply is accepted over the mailbox limit,
+ * as the number of requests in flight is up to their submitters anyway, and it must
+ * not hold up the other completions. */
+static void io_done(io_request_t *const request) {
+    cacti_io_result_t result = {.result = request->result, .buf = request->request.buf,
+            .context = request->request.context};
+    send(request->reply_to, MAILBOX_NORMAL, &(message_t){.message_type = request->reply_type,
+            .nbytes = sizeof(result)}, 1, &result, SEND_FORCE);
+    free(request);
+}
+
+int cacti_io_submit(actor_id_t reply_to, message_type_t reply_type,
+        const cacti_io_request_t *request) {
+    int result;
+    struct actor_system *sys;
+    if (receiver(reply_to, &sys, &result) == NULL)
+        return result;
+
+    io_request_t *r = malloc(sizeof(io_request_t));
+    if (r == NULL)
+        fatal("malloc failed");
+    r->request = *request;
+    r->reply_to = reply_to;
+    r->reply_type = reply_type;
+    if (!io_service_submit(&sys->io, r)) {
+        free(r);
+        return -2; // the system is ending
+    }
+    return 0;
+}
 
-        cond_signal(&act_system->new_request);
-        mutex_unlock(&act_system->mutex);
+#ifdef CACTI_STATS
+/* Must be called with systems_lock locked */
+static cacti_stats_t *stats_snapshot(struct actor_system *const sys) {
+    if (sys == NULL || sys->finished)
+        return NULL;
+    size_t pool_size = sys->pool_size;
+    cacti_stats_t *stats = calloc(1, sizeof(cacti_stats_t) +
+            pool_size * sizeof(cacti_worker_stats_t));
+    if (stats == NULL)
+        return NULL;
+
+    stats->messages_sent_outside = atomic_load_explicit(&sys->sent_outside,
+            memory_order_relaxed);
+    stats->alive_actors = atomic_load(&sys->alive_actors);
+    for (size_t i = 0; i < sys->nnodes; ++i) {
+        for (size_t p = 0; p < CACTI_PRIORITIES; ++p)
+            stats->global_queue_depth += atomic_load_explicit(&sys->nodes[i].queue_sizes[p],
+                    memory_order_relaxed);
+    }
+    stats->nworkers = pool_size;
+    for (size_t i = 0; i < pool_size; ++i) {
+        worker_t *const worker = &sys->workers[i];
+        worker_stats_read(&worker->stats, &stats->workers[i], stats->latency);
+        stats->workers[i].node = worker->node;
+        for (size_t p = 0; p < CACTI_PRIORITIES; ++p)
+            stats->workers[i].run_queue_depth += run_queue_size(&worker->run_queues[p]);
     }
+    return stats;
+}
+#endif
+
+cacti_stats_t *cacti_stats_snapshot() {
+#ifdef CACTI_STATS
+    int err;
+    mutex_lock(&systems_lock);
+    cacti_stats_t *stats = stats_snapshot(atomic_load(&systems[0]));
+    mutex_unlock(&systems_lock);
+    return stats;
+#else
+    return NULL;
+#endif
+}
+
+cacti_stats_t *cacti_stats_snapshot_of(actor_system_t *system) {
+#ifdef CACTI_STATS
+    int err;
+    mutex_lock(&systems_lock);
+    cacti_stats_t *stats = stats_snapshot(system);
+    mutex_unlock(&systems_lock);
+    return stats;
+#else
+    (void)system;
+    return NULL;
+#endif
+}
+
+int cacti_stats_actor(actor_id_t actor, cacti_actor_stats_t *stats) {
+#ifdef CACTI_STATS
+    struct actor_system *const sys = system_of(actor);
+    act_state_t *state = sys != NULL ? actor_state(sys, actor) : NULL;
+    if (state == NULL)
+        return -2; // no such actor
+    stats->messages_processed = stat_read(&state->processed);
+    stats->mailbox_size = mailbox_size(&state->mailbox);
+    stats->mailbox_high_water = atomic_load_explicit(&state->mailbox.high_water,
+            memory_order_relaxed);
     return 0;
+#else
+    (void)actor;
+    (void)stats;
+    return -1;
+#endif
+}
+
+int cacti_trace_dump(const char *path) {
+#ifdef CACTI_TRACE
+    int err;
+    mutex_lock(&systems_lock);
+    struct actor_system *const sys = atomic_load(&systems[0]);
+    int result = sys != NULL ? trace_dump(sys, path) : -1;
+    mutex_unlock(&systems_lock);
+    return result;
+#else
+    (void)path;
+    return -1;
+#endif
+}
+
+int cacti_trace_dump_of(actor_system_t *system, const char *path) {
+#ifdef CACTI_TRACE
+    int err;
+    mutex_lock(&systems_lock);
+    int result = !system->finished ? trace_dump(system, path) : -1;
+    mutex_unlock(&systems_lock);
+    return result;
+#else
+    (void)system;
+    (void)path;
+    return -1;
+#endif
 }
@@ -1,6 +1,7 @@
 #ifndef CACTI_H
 #define CACTI_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 typedef long message_type_t;
@@ -21,6 +22,16 @@ typedef long message_type_t;
 #define POOL_SIZE 3
 #endif
 
+/* Maximal size of a payload that can be carried by value in a mailbox */
+#ifndef INLINE_PAYLOAD_LIMIT
+#define INLINE_PAYLOAD_LIMIT 32
+#endif
+
+/* Default number of messages a worker processes on one actor in a row */
+#ifndef BUDGET_MESSAGES
+#define BUDGET_MESSAGES 16
+#endif
+
 typedef struct message {
     message_type_t message_type;
     size_t nbytes;
@@ -29,21 +40,324 @@ typedef struct message {
 
 typedef long actor_id_t;
 
+/* Returns the actor whose handler is running, or -1 outside of handlers. */
 actor_id_t actor_id_self();
 
 typedef void (*const act_t)(void **stateptr, size_t nbytes, void *data);
 
+/* Scheduling budget - bounds how long a worker keeps processing one actor's
+ * messages before it moves on to other actors. An actor with a deep mailbox
+ * may get up to a few times more messages, but never more time. */
+typedef struct budget {
+    size_t messages; // 0 means the system default
+    long nanos; // 0 means the system default, which is no time limit
+} budget_t;
+
+/* Actors of high priority are run before the others waiting for a worker,
+ * so a busy system may starve the latter. */
+typedef enum cacti_priority {
+    CACTI_PRIORITY_NORMAL = 0,
+    CACTI_PRIORITY_HIGH = 1,
+} cacti_priority_t;
+
+#define CACTI_PRIORITIES 2
+
 typedef struct role {
     size_t nprompts;
     act_t *prompts;
+    budget_t budget; // optional, overrides the system budget for actors of this role
+    cacti_priority_t priority; // of actors of this role
 } role_t;
 
 int actor_system_create(actor_id_t *actor, role_t *const role);
 
+/* Actor system configuration. Zeroed fields mean the defaults. */
+typedef struct actor_system_config {
+    size_t pool_size; // number of worker threads, all online CPUs by default
+    const int *cpu_affinity; // pool_size (given) CPUs to pin workers to, -1 for no pinning
+    size_t stack_size; // stack size of worker threads
+    size_t actors_capacity; // initial capacity of the actors registry
+    budget_t budget;
+    const char *trace_path; // where to dump the event trace when the system ends
+    // Workers are grouped by NUMA node: actors live in the memory of their spawner's
+    // node and workers look for work on their own node first. Nodes are read from
+    // /sys by default; a nonzero value simulates that many nodes without binding
+    // threads or memory to them.
+    size_t numa_nodes;
+    size_t io_threads; // serving file I/O without io_uring, CACTI_IO_THREADS by default
+    bool io_uring_disabled; // serve file I/O by the threads even if io_uring is available
+} actor_system_config_t;
+
+/* Works as actor_system_create, but the system is set up according to config
+ * (which may be NULL). Returns -1 in case of an invalid configuration. */
+int actor_system_create_ex(actor_id_t *actor, role_t *const role,
+        const actor_system_config_t *config);
+
+/* Sets the default budget of the system the actor belongs to.
+ * Returns -2 if there is no such actor. */
+int actor_system_set_budget(actor_id_t actor, budget_t budget);
+
 void actor_system_join(actor_id_t actor);
 
+/* A finished system keeps its threads and memory for a later system with the same
+ * pool size, stack size and NUMA nodes, which then starts without creating threads
+ * or allocating much. At most CACTI_SPARE_SYSTEMS systems are kept; systems whose
+ * workers are pinned to given CPUs are not. */
+#ifndef CACTI_SPARE_SYSTEMS
+#define CACTI_SPARE_SYSTEMS 4
+#endif
+
+/* Ends the threads kept for later systems and releases their memory. */
+void actor_system_release_spares();
+
+/* Systems created by actor_system_create share nothing with the ones created
+ * by actor_system_new - several of the latter may run at once, each with its own
+ * pool, registry and configuration. The high bits of an actor id tell the system
+ * of the actor, so messages are sent the same way to actors of any system,
+ * also across systems. */
+#ifndef CACTI_MAX_SYSTEMS
+#define CACTI_MAX_SYSTEMS 64
+#endif
+
+/* Bits of actor_id_t starting with this one hold the system of the actor. */
+#define CACTI_SYSTEM_SHIFT 40
+
+typedef struct actor_system actor_system_t;
+
+/* Works as actor_system_create_ex, but creates another independent system
+ * and stores its handle in *system. Returns -1 in case of an invalid configuration
+ * or if CACTI_MAX_SYSTEMS - 1 such systems already run. */
+int actor_system_new(actor_system_t **system, actor_id_t *actor, role_t *const role,
+        const actor_system_config_t *config);
+
+/* Waits until the system ends and releases its handle. Must be called once
+ * for each system created with actor_system_new. */
+void actor_system_wait(actor_system_t *system);
+
+/* Returns 0 on success, -1 if the actor does not accept messages and -2 if there
+ * is no such actor. If the actor's mailbox holds ACTOR_QUEUE_LIMIT messages,
+ * a thread outside of the system waits until there is room. A handler is never
+ * blocked - the message is accepted over the limit and the sending actor yields
+ * the rest of its turn, so that the receiver can catch up. */
 int send_message(actor_id_t actor, message_t message);
 
+/* Works as send_message, but the message goes to the control lane of the mailbox:
+ * it is handled before the ordinary messages waiting there and it is accepted even
+ * if the mailbox is full. Messages of different lanes are not ordered with each other.
+ * MSG_GODIE sent this way makes the actor stop accepting messages before it handles
+ * the ones already waiting. */
+int send_message_urgent(actor_id_t actor, message_t message);
+
+/* As send_message, but returns -3 instead of waiting or exceeding the limit
+ * if the actor's mailbox is full. */
+int try_send_message(actor_id_t actor, message_t message);
+
+/* Allocates a message payload of size bytes from a pool of the calling thread.
+ * Returns NULL if memory cannot be allocated. */
+void *cacti_msg_alloc(size_t size);
+
+/* Frees a payload allocated with cacti_msg_alloc. It may be called by any thread,
+ * in particular by a handler of an actor the payload was sent to. */
+void cacti_msg_free(void *ptr);
+
+/* Sends a message carrying a copy of nbytes (at most INLINE_PAYLOAD_LIMIT)
+ * bytes of data, which saves allocating a payload for small messages.
+ * The handler gets a pointer to the copy, valid until the handler returns.
+ * Returns values as send_message. */
+int send_message_inline(actor_id_t actor, message_type_t message_type,
+        const void *data, size_t nbytes);
+
+/* Sends n messages to the actor at once; they are received in order.
+ * Either all of them are accepted or none. Returns values as send_message,
+ * or -3 if a thread outside of the system sends more than ACTOR_QUEUE_LIMIT
+ * messages at once. */
+int send_messages(actor_id_t actor, const message_t *msgs, size_t n);
+
+/* Sends the message to each of n targets. The data pointer is shared by all
+ * the receivers. Returns 0 if all targets got the message, otherwise the value
+ * send_message would return for the last target which did not. */
+int send_multicast(const actor_id_t *targets, size_t n, message_t msg);
+
+/* Shared payloads are immutable buffers which many messages carry without copying.
+ * Each message carrying a payload holds a reference to it, which the runtime gives up
+ * once the handler of the message returns or the message is dropped. The payload is
+ * freed when its last reference is gone. */
+
+/* Allocates a shared payload of size bytes, to be filled before it is sent.
+ * The caller holds a reference to it. Returns NULL if memory cannot be allocated. */
+void *cacti_shared_alloc(size_t size);
+
+/* Takes another reference to the payload, e.g. to keep it after the handler returns. */
+void cacti_shared_retain(void *data);
+
+/* Gives up a reference to the payload. */
+void cacti_shared_release(void *data);
+
+/* Sends a message of the given type carrying the shared payload to each of n targets.
+ * The handler gets the payload and its size, and must not modify the payload.
+ * The caller keeps its reference. Returns values as send_multicast. */
+int send_shared(const actor_id_t *targets, size_t n, message_type_t message_type, void *data);
+
+/* Futures let threads outside of the system ask actors and wait for their answers.
+ * A future is completed once, by a reply or by the end of the system of the actor
+ * the request was sent to. */
+typedef struct cacti_future cacti_future_t;
+
+/* Data of a message sent by send_request, valid until the handler returns */
+typedef struct cacti_request {
+    void *data;
+    cacti_future_t *future; // for cacti_reply, which any actor or thread may call
+} cacti_request_t;
+
+/* Sends the actor a message of the given type carrying a cacti_request_t and stores
+ * a future for the reply in *future. Returns values as send_message; the future is
+ * created only on success and has to be released with cacti_future_free. */
+int send_request(actor_id_t actor, message_type_t message_type, void *data,
+        cacti_future_t **future);
+
+/* Completes the future with the result. It has to be called at most once for each
+ * request, before the system of the actor the request was sent to ends - the future
+ * may be gone afterwards. */
+void cacti_reply(cacti_future_t *future, void *result);
+
+/* Waits until the future is completed and stores the reply in *result. Returns -1
+ * if the system ended without a reply. Handlers should not wait, as they hold
+ * a worker meanwhile. */
+int cacti_future_wait(cacti_future_t *future, void **result);
+
+/* Works as cacti_future_wait, but returns 1 at once if the future is not completed. */
+int cacti_future_poll(cacti_future_t *future, void **result);
+
+/* Releases the future. A reply which comes later is dropped. */
+void cacti_future_free(cacti_future_t *future);
+
+/* Timers send messages later without occupying workers - they are kept in a timing
+ * wheel of the target's system and fired by a thread of the system. Delays are given
+ * in nanoseconds and rounded up to whole ticks. */
+#ifndef CACTI_TIMER_TICK
+#define CACTI_TIMER_TICK 1000000L
+#endif
+
+typedef struct cacti_timer {
+    actor_id_t actor;
+    unsigned long id;
+} cacti_timer_t;
+
+/* Sends the message to the actor after delay nanoseconds and then every period
+ * nanoseconds if period is positive, until the timer is cancelled or the actor stops
+ * accepting messages. A message which finds the mailbox full is sent in the next tick.
+ * Stores a handle of the timer in *timer unless it is NULL. Returns 0 on success,
+ * -1 if the actor does not accept messages and -2 if there is no such actor. */
+int cacti_timer_start(cacti_timer_t *timer, actor_id_t actor, message_t message, long delay,
+        long period);
+
+/* Works as cacti_timer_start for a single message and no handle. */
+int send_message_after(actor_id_t actor, message_t message, long delay);
+
+/* Stops the timer. Returns -1 if it has already sent its last message
+ * or it has been cancelled. */
+int cacti_timer_cancel(cacti_timer_t timer);
+
+/* Asynchronous file I/O - handlers submit requests instead of blocking workers
+ * in system calls, and learn the results from messages. Requests of a system are
+ * served by io_uring where the kernel supports it, otherwise by a pool of threads
+ * making blocking calls, started with the first request. */
+#ifndef CACTI_IO_THREADS
+#define CACTI_IO_THREADS 4
+#endif
+
+typedef enum cacti_io_op {
+    CACTI_IO_READ,
+    CACTI_IO_WRITE,
+    CACTI_IO_FSYNC,
+} cacti_io_op_t;
+
+typedef struct cacti_io_request {
+    cacti_io_op_t op;
+    int fd;
+    void *buf; // buf, nbytes and offset are ignored by CACTI_IO_FSYNC
+    size_t nbytes;
+    long offset; // in the file
+    void *context; // passed back with the result
+} cacti_io_request_t;
+
+/* Data of the message telling that a request is done */
+typedef struct cacti_io_result {
+    long result; // number of bytes transferred, which may be short, or -errno
+    void *buf;
+    void *context;
+} cacti_io_result_t;
+
+/* Submits the request. Once it is done, a message of type reply_type carrying
+ * a cacti_io_result_t (valid until the handler returns) is sent to reply_to, even if
+ * its mailbox is full. The buffer has to stay valid until then. Returns values as
+ * send_message for reply_to. A system ends only once its requests are done. */
+int cacti_io_submit(actor_id_t reply_to, message_type_t reply_type,
+        const cacti_io_request_t *request);
+
+/* Runtime statistics - collected only if the library is built with CACTI_STATS */
+
+/* Enqueue-to-handler latency histogram: values below CACTI_LATENCY_SUB_BUCKETS
+ * nanoseconds have a bucket each, further powers of two are split
+ * into CACTI_LATENCY_SUB_BUCKETS buckets each. */
+#define CACTI_LATENCY_SUB_BUCKETS 8
+#define CACTI_LATENCY_BUCKETS (40 * CACTI_LATENCY_SUB_BUCKETS)
+
+typedef struct cacti_worker_stats {
+    unsigned long messages_sent; // by handlers run on the worker
+    unsigned long messages_processed;
+    unsigned long steals;
+    unsigned long parks;
+    unsigned long spawned;
+    unsigned long died; // MSG_GODIE handled
+    size_t run_queue_depth;
+    size_t run_queue_high_water;
+    size_t node; // NUMA node group of the worker
+} cacti_worker_stats_t;
+
+typedef struct cacti_stats {
+    unsigned long messages_sent_outside; // by threads outside of the pool
+    size_t alive_actors;
+    size_t global_queue_depth;
+    unsigned long latency[CACTI_LATENCY_BUCKETS]; // of all workers
+    size_t nworkers;
+    cacti_worker_stats_t workers[];
+} cacti_stats_t;
+
+typedef struct cacti_actor_stats {
+    unsigned long messages_processed;
+    size_t mailbox_size;
+    size_t mailbox_high_water;
+} cacti_actor_stats_t;
+
+/* Returns the current statistics of the system, to be released with free(),
+ * or NULL if there is no system or it does not collect statistics.
+ * Counters are read without stopping the workers, so they may be slightly off. */
+cacti_stats_t *cacti_stats_snapshot();
+
+/* Works as cacti_stats_snapshot for a system created with actor_system_new. */
+cacti_stats_t *cacti_stats_snapshot_of(actor_system_t *system);
+
+/* Returns -1 if statistics are not collected, -2 if there is no such actor. */
+int cacti_stats_actor(actor_id_t actor, cacti_actor_stats_t *stats);
+
+/* Returns an upper bound of the given percentile (0-100) of enqueue-to-handler
+ * latency in nanoseconds, or -1 if no message was handled. */
+long cacti_stats_latency_percentile(const cacti_stats_t *stats, double percentile);
+
+/* Writes the latest events of the system (sends, scheduling, handlers, spawns,
+ * deaths and parking of workers) to path in Chrome trace JSON format, which
+ * chrome://tracing and Perfetto can open. Returns -1 if the file cannot be written,
+ * there is no system or the library is built without CACTI_TRACE.
+ * The workers are not stopped: their event rings are read while they keep writing
+ * them, without synchronization, so events being recorded during the dump may be
+ * skipped or torn, and a handler may be seen to begin without its end. The dump
+ * made when the system ends (see trace_path) is exact. */
+int cacti_trace_dump(const char *path);
+
+/* Works as cacti_trace_dump for a system created with actor_system_new. */
+int cacti_trace_dump_of(actor_system_t *system, const char *path);
+
 #endif
 
 /*
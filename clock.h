@@ -0,0 +1,13 @@
+#ifndef CACTI_CLOCK_H
+#define CACTI_CLOCK_H
+
+#include <time.h>
+
+/* Nanoseconds of the monotonic clock, which timers, budgets, statistics and traces share */
+static inline long monotonic_nanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+#endif //CACTI_CLOCK_H
@@ -0,0 +1,338 @@
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "io_service.h"
+#include "err.h"
+
+/* The raw system calls of io_uring, which libc does not wrap */
+static int ring_setup(unsigned entries, struct io_uring_params *const params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+int io_service_init(io_service_t *const s, io_complete_t complete, size_t nthreads,
+        bool uring) {
+    if (pthread_mutex_init(&s->mutex, NULL) != 0)
+        return -1;
+    if (pthread_cond_init(&s->cond, NULL) != 0) {
+        pthread_mutex_destroy(&s->mutex);
+        return -1;
+    }
+    s->complete = complete;
+    s->nthreads = nthreads;
+    s->uring = uring;
+    s->started = false;
+    s->stopping = false;
+    s->in_flight = 0;
+    s->queue_head = NULL;
+    s->queue_tail = NULL;
+    s->threads = NULL;
+    s->ring_fd = -1;
+    s->ring_load = 0;
+    return 0;
+}
+
+/* Maps the rings of a new io_uring instance. Returns -1 if the kernel does not
+ * let us have one - it may be too old or io_uring may be disabled. */
+static int ring_open(io_service_t *const s) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = ring_setup(IO_RING_ENTRIES, &p);
+    if (fd < 0)
+        return -1;
+
+    s->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    s->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    s->sq_map = mmap(NULL, s->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_SQ_RING);
+    if (s->sq_map == MAP_FAILED)
+        goto SQ_MAP_FAILED;
+    s->cq_map = mmap(NULL, s->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_CQ_RING);
+    if (s->cq_map == MAP_FAILED)
+        goto CQ_MAP_FAILED;
+    s->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (s->sqes == MAP_FAILED)
+        goto SQES_MAP_FAILED;
+
+    char *const sq = s->sq_map, *const cq = s->cq_map;
+    s->sq_head = (_Atomic unsigned *)(sq + p.sq_off.head);
+    s->sq_tail = (_Atomic unsigned *)(sq + p.sq_off.tail);
+    s->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    s->sq_array = (unsigned *)(sq + p.sq_off.array);
+    s->cq_head = (_Atomic unsigned *)(cq + p.cq_off.head);
+    s->cq_tail = (_Atomic unsigned *)(cq + p.cq_off.tail);
+    s->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    s->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    s->sq_entries = p.sq_entries;
+    s->cq_entries = p.cq_entries;
+    s->ring_fd = fd;
+    return 0;
+
+    // Rollback in case of failure
+    SQES_MAP_FAILED:
+    munmap(s->cq_map, s->cq_map_size);
+    CQ_MAP_FAILED:
+    munmap(s->sq_map, s->sq_map_size);
+    SQ_MAP_FAILED:
+    close(fd);
+    return -1;
+}
+
+static void ring_close(io_service_t *const s) {
+    munmap(s->sqes, s->sq_entries * sizeof(struct io_uring_sqe));
+    munmap(s->cq_map, s->cq_map_size);
+    munmap(s->sq_map, s->sq_map_size);
+    close(s->ring_fd);
+    s->ring_fd = -1;
+}
+
+/* Puts an entry for the request (or a no-op if it is NULL) in the submission queue.
+ * The caller holds the mutex and makes sure there is room. */
+static void ring_prepare(io_service_t *const s, io_request_t *const request) {
+    unsigned tail = atomic_load_explicit(s->sq_tail, memory_order_relaxed);
+    unsigned index = tail & *s->sq_mask;
+    struct io_uring_sqe *const sqe = &s->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (request == NULL) {
+        sqe->opcode = IORING_OP_NOP;
+    } else {
+        const cacti_io_request_t *const r = &request->request;
+        sqe->fd = r->fd;
+        sqe->user_data = (uintptr_t)request;
+        switch (r->op) {
+            case CACTI_IO_READ:
+            case CACTI_IO_WRITE:
+                // the vectored operations are the ones every kernel with io_uring has
+                sqe->opcode = r->op == CACTI_IO_READ ? IORING_OP_READV : IORING_OP_WRITEV;
+                sqe->addr = (uintptr_t)&request->iov;
+                sqe->len = 1;
+                sqe->off = (uint64_t)r->offset;
+                break;
+            case CACTI_IO_FSYNC:
+                sqe->opcode = IORING_OP_FSYNC;
+                break;
+        }
+        ++s->ring_load;
+    }
+    s->sq_array[index] = index;
+    atomic_store_explicit(s->sq_tail, tail + 1, memory_order_release);
+}
+
+/* Hands the prepared entries to the kernel. The caller holds the mutex. */
+static void ring_submit(io_service_t *const s) {
+    unsigned pending;
+    while ((pending = atomic_load_explicit(s->sq_tail, memory_order_relaxed)
+            - atomic_load_explicit(s->sq_head, memory_order_acquire)) > 0) {
+        if (ring_enter(s->ring_fd, pending, 0, 0) < 0 && errno != EINTR)
+            syserr(errno, "io_uring_enter failed");
+    }
+}
+
+/* Moves queued requests to the ring as long as there is room for them.
+ * The caller holds the mutex. */
+static void ring_fill(io_service_t *const s) {
+    bool prepared = false;
+    while (s->queue_head != NULL && s->ring_load < s->sq_entries) {
+        io_request_t *const request = s->queue_head;
+        if ((s->queue_head = request->next) == NULL)
+            s->queue_tail = NULL;
+        ring_prepare(s, request);
+        prepared = true;
+    }
+    if (prepared)
+        ring_submit(s);
+}
+
+/* Reaps completions of the ring until the service stops and nothing is in flight. */
+static void *ring_main(void *data) {
+    int err;
+    io_service_t *const s = data;
+
+    while (true) {
+        mutex_lock(&s->mutex);
+        bool done = s->stopping && s->in_flight == 0;
+        mutex_unlock(&s->mutex);
+        if (done)
+            break;
+
+        if (ring_enter(s->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            syserr(errno, "io_uring_enter failed");
+
+        // requests are touched under the mutex, as it orders them after their submission
+        // for tools which do not know that the kernel does it as well
+        mutex_lock(&s->mutex);
+        io_request_t *completed = NULL, **last = &completed;
+        size_t ncompleted = 0;
+        unsigned head = atomic_load_explicit(s->cq_head, memory_order_relaxed);
+        unsigned tail = atomic_load_explicit(s->cq_tail, memory_order_acquire);
+        for (; head != tail; ++head) {
+            struct io_uring_cqe *const cqe = &s->cqes[head & *s->cq_mask];
+            io_request_t *const request = (io_request_t *)(uintptr_t)cqe->user_data;
+            if (request == NULL)
+                continue; // the no-op waking us up to stop
+            request->result = cqe->res;
+            *last = request;
+            last = &request->next;
+            ++ncompleted;
+        }
+        *last = NULL;
+        atomic_store_explicit(s->cq_head, head, memory_order_release);
+        s->ring_load -= ncompleted;
+        ring_fill(s);
+        mutex_unlock(&s->mutex);
+
+        while (completed != NULL) {
+            io_request_t *const next = completed->next;
+            s->complete(completed);
+            completed = next;
+        }
+
+        mutex_lock(&s->mutex);
+        s->in_flight -= ncompleted;
+        mutex_unlock(&s->mutex);
+    }
+    return NULL;
+}
+
+/* Makes the blocking call the request asks for. */
+static long perform(const io_request_t *const request) {
+    const cacti_io_request_t *const r = &request->request;
+    long result;
+    do {
+        switch (r->op) {
+            case CACTI_IO_READ:
+                result = pread(r->fd, request->iov.iov_base, request->iov.iov_len, r->offset);
+                break;
+            case CACTI_IO_WRITE:
+                result = pwrite(r->fd, request->iov.iov_base, request->iov.iov_len, r->offset);
+                break;
+            default:
+                result = fsync(r->fd);
+        }
+    } while (result < 0 && errno == EINTR);
+    return result < 0 ? -errno : result;
+}
+
+/* A thread of the pool serving requests without io_uring */
+static void *pool_main(void *data) {
+    int err;
+    io_service_t *const s = data;
+
+    mutex_lock(&s->mutex);
+    while (true) {
+        while (s->queue_head == NULL && !s->stopping)
+            cond_wait(&s->cond, &s->mutex);
+        io_request_t *const request = s->queue_head;
+        if (request == NULL)
+            break;
+        if ((s->queue_head = request->next) == NULL)
+            s->queue_tail = NULL;
+        mutex_unlock(&s->mutex);
+
+        request->result = perform(request);
+        s->complete(request);
+
+        mutex_lock(&s->mutex);
+        --s->in_flight;
+    }
+    mutex_unlock(&s->mutex);
+    return NULL;
+}
+
+/* Starts the completion thread of a ring, or the pool if there is no ring.
+ * The caller holds the mutex. */
+static void start(io_service_t *const s) {
+    int err;
+    bool ring = s->ring_fd >= 0 || (s->uring && ring_open(s) == 0);
+    size_t nthreads = ring ? 1 : s->nthreads;
+    if ((s->threads = malloc(nthreads * sizeof(pthread_t))) == NULL)
+        fatal("malloc failed");
+    for (size_t i = 0; i < nthreads; ++i) {
+        verify(pthread_create(&s->threads[i], NULL, ring ? ring_main : pool_main, s),
+                "pthread_create failed");
+    }
+    s->nthreads = nthreads;
+    s->started = true;
+}
+
+bool io_service_submit(io_service_t *const s, io_request_t *const request) {
+    int err;
+    cacti_io_request_t *const r = &request->request;
+    request->next = NULL;
+    request->iov.iov_base = r->buf;
+    request->iov.iov_len = r->nbytes > IO_MAX_BYTES ? IO_MAX_BYTES : r->nbytes;
+
+    mutex_lock(&s->mutex);
+    if (s->stopping) {
+        mutex_unlock(&s->mutex);
+        return false;
+    }
+    if (!s->started)
+        start(s);
+    ++s->in_flight;
+    if (s->ring_fd >= 0 && s->queue_head == NULL && s->ring_load < s->sq_entries) {
+        ring_prepare(s, request);
+        ring_submit(s);
+    } else {
+        if (s->queue_tail == NULL)
+            s->queue_head = request;
+        else
+            s->queue_tail->next = request;
+        s->queue_tail = request;
+        if (s->ring_fd < 0)
+            cond_signal(&s->cond);
+    }
+    mutex_unlock(&s->mutex);
+    return true;
+}
+
+void io_service_stop(io_service_t *const s) {
+    int err;
+    mutex_lock(&s->mutex);
+    s->stopping = true;
+    bool started = s->started;
+    if (s->ring_fd >= 0 && s->in_flight == 0) {
+        // the completion thread may be waiting for a completion which would never come
+        ring_prepare(s, NULL);
+        ring_submit(s);
+    }
+    cond_broadcast(&s->cond);
+    mutex_unlock(&s->mutex);
+    if (!started)
+        return;
+    for (size_t i = 0; i < s->nthreads; ++i)
+        verify(pthread_join(s->threads[i], NULL), "pthread_join failed");
+}
+
+void io_service_reset(io_service_t *const s, size_t nthreads, bool uring) {
+    if (s->ring_fd >= 0 && !uring)
+        ring_close(s);
+    free(s->threads);
+    s->threads = NULL;
+    s->nthreads = nthreads;
+    s->uring = uring;
+    s->started = false;
+    s->stopping = false;
+}
+
+void io_service_destroy(io_service_t *const s) {
+    int err;
+    if (s->ring_fd >= 0)
+        ring_close(s);
+    free(s->threads);
+    cond_destroy(&s->cond);
+    mutex_destroy(&s->mutex);
+}
@@ -0,0 +1,73 @@
+#ifndef CACTI_IO_SERVICE_H
+#define CACTI_IO_SERVICE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#include "cacti.h"
+
+/* Number of submission queue entries of a ring; the completion queue is twice as big */
+#define IO_RING_ENTRIES 256
+
+/* Longest transfer of a single request, longer ones are cut short */
+#define IO_MAX_BYTES (1UL << 30)
+
+typedef struct io_request {
+    struct io_request *next; // in the queue of the service
+    cacti_io_request_t request;
+    struct iovec iov;
+    actor_id_t reply_to;
+    message_type_t reply_type;
+    long result; // number of bytes transferred or -errno
+} io_request_t;
+
+/* Called by a thread of the service once the request is done */
+typedef void (*io_complete_t)(io_request_t *request);
+
+/* Serves file I/O requests with io_uring, or with a pool of threads making blocking
+ * calls if io_uring is not available. The ring is fed by the submitting threads
+ * and drained by a completion thread. It holds at most IO_RING_ENTRIES requests,
+ * further ones wait in the queue until completions make room. */
+typedef struct {
+    pthread_mutex_t mutex; // guards the fields below
+    pthread_cond_t cond; // signals queued requests to the pool
+    io_complete_t complete;
+    size_t nthreads; // of the pool
+    bool uring; // may be used
+    bool started;
+    bool stopping;
+    size_t in_flight; // submitted and not completed
+    io_request_t *queue_head, *queue_tail;
+    pthread_t *threads;
+    // the ring, if ring_fd is not -1
+    int ring_fd;
+    size_t ring_load; // requests in the ring
+    unsigned sq_entries, cq_entries;
+    void *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size;
+    struct io_uring_sqe *sqes;
+    _Atomic unsigned *sq_head, *sq_tail, *cq_head, *cq_tail;
+    unsigned *sq_mask, *sq_array, *cq_mask;
+    struct io_uring_cqe *cqes;
+} io_service_t;
+
+/* Starts no threads yet, they are started with the first request.
+ * Returns -1 on failure. */
+int io_service_init(io_service_t *const s, io_complete_t complete, size_t nthreads,
+        bool uring);
+
+/* Takes the ownership of the request. Returns false if the service is stopping. */
+bool io_service_submit(io_service_t *const s, io_request_t *const request);
+
+/* Waits for the requests in flight to complete and for the threads to end. */
+void io_service_stop(io_service_t *const s);
+
+/* Makes a stopped service take requests again, served as io_service_init describes.
+ * An open ring is kept if it may be used. */
+void io_service_reset(io_service_t *const s, size_t nthreads, bool uring);
+
+void io_service_destroy(io_service_t *const s);
+
+#endif //CACTI_IO_SERVICE_H
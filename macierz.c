@@ -2,7 +2,6 @@
 #include "err.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
 #include <stdbool.h>
 #include <assert.h>
 
@@ -11,6 +10,13 @@ struct field {
     int t;
 };
 
+struct rowsum {
+    int curr_row;
+    long long sum;
+};
+
+/* Rows come to a column in order and leave it in order. While the cost of a field
+ * is being waited for with a timer, the rows coming next wait in the queue. */
 struct state {
     int n;
     int k;
@@ -18,25 +24,32 @@ struct state {
     actor_id_t child;
     actor_id_t leader;
     struct field** matrix;
-};
-
-struct rowsum {
-    int curr_row;
-    long long sum;
+    struct rowsum *queue; // of n rows
+    int queue_head;
+    int queue_tail;
+    bool busy; // the row at queue_head is being computed
 };
 
 const int MSG_INTRO = 0x1;
 const int MSG_ASSGN = 0x2;
 const int MSG_READY = 0x3;
 const int MSG_COMP = 0x4;
+const int MSG_START = 0x5;
+const int MSG_DONE = 0x6;
+
+/* Number of rows started with one send_messages call */
+#define START_BATCH 64
 
 void hello(void **stateptr, size_t nbytes, void *data);
 void introduce(struct state **stateptr, size_t nbytes, void *data);
 void assign(struct state **stateptr, size_t nbytes, struct state *data);
 void ready(struct state **stateptr, size_t nbytes, void *data);
 void compute_row(struct state **stateptr, size_t nbytes, struct rowsum *data);
+void start_row(struct state **stateptr, size_t nbytes, void *data);
+void row_done(struct state **stateptr, size_t nbytes, void *data);
 
-act_t prompts[] = {(act_t)hello, (act_t)introduce, (act_t)assign, (act_t)ready, (act_t)compute_row};
+act_t prompts[] = {(act_t)hello, (act_t)introduce, (act_t)assign, (act_t)ready, (act_t)compute_row,
+                   (act_t)start_row, (act_t)row_done};
 role_t role = {.nprompts = sizeof(prompts) / sizeof(act_t), .prompts = prompts};
 
 void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
@@ -49,13 +62,14 @@ void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size
 void introduce(struct state **stateptr, __attribute__((unused)) size_t nbytes,
         void *data) {
     (*stateptr)->child = (actor_id_t)data;
-    struct state *child_stateptr = malloc(sizeof(struct state));
+    struct state *child_stateptr = cacti_msg_alloc(sizeof(struct state));
     if (!child_stateptr)
         fatal("malloc failed");
     child_stateptr->my_col = (*stateptr)->my_col + 1;
     child_stateptr->n = (*stateptr)->n;
     child_stateptr->k = (*stateptr)->k;
     child_stateptr->matrix = (*stateptr)->matrix;
+    child_stateptr->leader = (*stateptr)->leader;
 
     send_message((*stateptr)->child, (message_t)
             {.message_type = MSG_ASSGN, .nbytes = sizeof(struct state),
@@ -65,6 +79,12 @@ void introduce(struct state **stateptr, __attribute__((unused)) size_t nbytes,
 void assign(struct state **stateptr, __attribute__((unused)) size_t nbytes,
         struct state *data) {
     *stateptr = data;
+    (*stateptr)->queue = malloc((*stateptr)->n * sizeof(struct rowsum));
+    if (!(*stateptr)->queue)
+        fatal("malloc failed");
+    (*stateptr)->queue_head = 0;
+    (*stateptr)->queue_tail = 0;
+    (*stateptr)->busy = false;
     if ((*stateptr)->my_col + 1 < (*stateptr)->k)
         send_message(actor_id_self(), (message_t)
                 {.message_type = MSG_SPAWN, .nbytes = sizeof(role_t),
@@ -78,39 +98,66 @@ void ready(struct state **stateptr, __attribute__((unused)) size_t nbytes,
            __attribute__((unused)) void *data) {
     // if the actor handling is the leader, start computation for each row
     assert((*stateptr)->my_col == 0);
-    for (int i = 0; i < (*stateptr)->n; ++i) {
-        struct rowsum *sum = malloc(sizeof(struct rowsum));
-        if (!sum)
-            fatal("malloc failed");
-        sum->curr_row = i;
-        sum->sum = 0;
-        send_message(actor_id_self(), (message_t)
-                {.message_type = MSG_COMP, .nbytes = sizeof(struct rowsum), .data = sum});
+    message_t batch[START_BATCH];
+    for (int i = 0; i < (*stateptr)->n; i += START_BATCH) {
+        int m = (*stateptr)->n - i < START_BATCH ? (*stateptr)->n - i : START_BATCH;
+        for (int j = 0; j < m; ++j)
+            batch[j] = (message_t){.message_type = MSG_START, .data = (void*)(long)(i + j)};
+        send_messages(actor_id_self(), batch, m);
+    }
+}
+
+void start_row(struct state **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    struct rowsum sum = {.curr_row = (int)(long)data, .sum = 0};
+    compute_row(stateptr, sizeof(struct rowsum), &sum);
+}
+
+/* Passes the first waiting row, which is computed, to the next column.
+ * Returns true if it was the last row, after which the actor dies. */
+static bool finish_row(struct state *state) {
+    struct rowsum row = state->queue[state->queue_head++];
+    if (state->my_col + 1 < state->k)
+        send_message_inline(state->child, MSG_COMP, &row, sizeof(struct rowsum));
+    else
+        printf("%lld\n", row.sum);
+
+    if (row.curr_row + 1 < state->n)
+        return false;
+    free(state->queue);
+    cacti_msg_free(state);
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+    return true;
+}
+
+/* Computes the waiting rows. The cost of a field is waited for with a timer,
+ * so the worker is free to compute other columns meanwhile. */
+static void next_rows(struct state *state) {
+    while (!state->busy && state->queue_head != state->queue_tail) {
+        struct rowsum *row = &state->queue[state->queue_head];
+        struct field f = state->matrix[row->curr_row][state->my_col];
+        row->sum += f.v;
+        if (f.t > 0) {
+            state->busy = true;
+            if (send_message_after(actor_id_self(), (message_t){.message_type = MSG_DONE},
+                    1000000L * f.t) != 0)
+                fatal("failed to start a timer");
+        } else if (finish_row(state))
+            return;
     }
 }
 
 void compute_row(struct state **stateptr, __attribute__((unused)) size_t nbytes,
         struct rowsum *data) {
-    bool free_data = false;
-
-    struct field f = (*stateptr)->matrix[data->curr_row][(*stateptr)->my_col];
-    data->sum += f.v;
-    usleep(1000 * f.t);
-
-    if ((*stateptr)->my_col + 1 < (*stateptr)->k) {
-        send_message((*stateptr)->child, (message_t)
-            {.message_type = MSG_COMP, .nbytes = sizeof(struct rowsum),
-                    .data = data});
-    } else {
-        printf("%lld\n", data->sum);
-        free_data = true;
-    }
-    if (data->curr_row + 1 == (*stateptr)->n) {
-        free(*stateptr);
-        send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
-    }
-    if (free_data)
-        free(data);
+    // data is a copy owned by the runtime, valid only until the handler returns
+    (*stateptr)->queue[(*stateptr)->queue_tail++] = *data;
+    next_rows(*stateptr);
+}
+
+void row_done(struct state **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    (*stateptr)->busy = false;
+    if (!finish_row(*stateptr))
+        next_rows(*stateptr);
 }
 
 int main() {
@@ -138,7 +185,7 @@ int main() {
     if (actor_system_create(&leader, &role) != 0)
         fatal("failed to create actor system");
 
-    struct state *leader_state = malloc(sizeof(struct state));
+    struct state *leader_state = cacti_msg_alloc(sizeof(struct state));
     if (!leader_state)
         fatal("malloc failed");
     leader_state->k = k;
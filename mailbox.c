@@ -0,0 +1,155 @@
+#include <string.h>
+
+#include "mailbox.h"
+#include "err.h"
+
+/* Nodes are taken from the message pools of their senders. A node freed by the consumer
+ * goes back to its sender's pool in a batch, so in steady traffic neither of them
+ * calls malloc or free. */
+static mailbox_node_t *node_alloc() {
+    mailbox_node_t *node = cacti_msg_alloc(sizeof(mailbox_node_t));
+    if (node == NULL)
+        fatal("cacti_msg_alloc failed");
+    return node;
+}
+
+void mailbox_node_free(mailbox_node_t *const node) {
+    cacti_msg_free(node);
+}
+
+static mailbox_node_t *stub_of(mailbox_t *const mb, size_t lane) {
+    return (mailbox_node_t *)&mb->stubs[lane];
+}
+
+void mailbox_init(mailbox_t *const mb, size_t limit) {
+    for (size_t i = 0; i < MAILBOX_LANES; ++i) {
+        atomic_init(&mb->stubs[i].next, NULL);
+        atomic_init(&mb->heads[i], stub_of(mb, i));
+        mb->tails[i] = stub_of(mb, i);
+    }
+    atomic_init(&mb->state, 0);
+    mb->limit = limit;
+    stats(atomic_init(&mb->high_water, 0));
+}
+
+void mailbox_destroy(mailbox_t *const mb) {
+    for (size_t i = 0; i < MAILBOX_LANES; ++i) {
+        mailbox_node_t *node = mb->tails[i];
+        while (node != NULL) {
+            mailbox_node_t *next = atomic_load_explicit(&node->next, memory_order_relaxed);
+            if (node != stub_of(mb, i))
+                mailbox_node_free(node);
+            node = next;
+        }
+    }
+}
+
+/* Appends the chain of nodes from first to last to the lane with a single exchange. */
+static void push_chain(mailbox_t *const mb, size_t lane, mailbox_node_t *const first,
+        mailbox_node_t *const last) {
+    atomic_store_explicit(&last->next, NULL, memory_order_relaxed);
+    mailbox_node_t *prev = atomic_exchange_explicit(&mb->heads[lane], last, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, first, memory_order_release);
+}
+
+static void push_node(mailbox_t *const mb, size_t lane, mailbox_node_t *const node) {
+    push_chain(mb, lane, node, node);
+}
+
+/* Reserves n places in the mailbox, beyond its limit if overflow is set.
+ * Returns the previous number of messages or -1 if there is not enough room. */
+static long reserve(mailbox_t *const mb, size_t n, bool overflow) {
+    // A place in the mailbox is reserved before the message becomes visible,
+    // so the consumer never releases more messages than were accounted for.
+    size_t state = atomic_load_explicit(&mb->state, memory_order_relaxed);
+    do {
+        if (!overflow && (state > mb->limit || n > mb->limit - state))
+            return -1;
+    } while (!atomic_compare_exchange_weak_explicit(&mb->state, &state, state + n,
+            memory_order_acq_rel, memory_order_relaxed));
+    stats(stat_max(&mb->high_water, state + n));
+    return (long)state;
+}
+
+int mailbox_push(mailbox_t *const mb, size_t lane, message_t message, const void *payload,
+        bool overflow, bool *const was_idle) {
+    long state = reserve(mb, 1, overflow);
+    if (state < 0)
+        return -1;
+
+    mailbox_node_t *node = node_alloc();
+    node->message = message;
+    stats(node->enqueued = monotonic_nanos());
+    if (payload != NULL) {
+        memcpy(node->payload, payload, message.nbytes);
+        node->message.data = node->payload;
+    }
+    push_node(mb, lane, node);
+
+    *was_idle = state == 0;
+    return (size_t)state + 1 > mb->limit;
+}
+
+int mailbox_push_batch(mailbox_t *const mb, size_t lane, const message_t *const messages,
+        size_t n, bool overflow, bool *const was_idle) {
+    long state = reserve(mb, n, overflow);
+    if (state < 0)
+        return -1;
+
+    mailbox_node_t *first = NULL, *last = NULL;
+#ifdef CACTI_STATS
+    long now = monotonic_nanos();
+#endif
+    for (size_t i = 0; i < n; ++i) {
+        mailbox_node_t *node = node_alloc();
+        node->message = messages[i];
+        stats(node->enqueued = now);
+        if (last == NULL)
+            first = node;
+        else
+            atomic_store_explicit(&last->next, node, memory_order_relaxed);
+        last = node;
+    }
+    push_chain(mb, lane, first, last);
+
+    *was_idle = state == 0;
+    return (size_t)state + n > mb->limit;
+}
+
+static mailbox_node_t *lane_pop(mailbox_t *const mb, size_t lane) {
+    mailbox_node_t *const stub = stub_of(mb, lane);
+    mailbox_node_t *tail = mb->tails[lane];
+    mailbox_node_t *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == stub) {
+        if (next == NULL)
+            return NULL;
+        mb->tails[lane] = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (next == NULL) {
+        if (tail != atomic_load_explicit(&mb->heads[lane], memory_order_acquire))
+            return NULL; // some producer is in the middle of push
+        // tail is the last node - the stub takes its place, so it can be taken
+        push_node(mb, lane, stub);
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+        if (next == NULL)
+            return NULL;
+    }
+    mb->tails[lane] = next;
+    return tail;
+}
+
+mailbox_node_t *mailbox_pop(mailbox_t *const mb) {
+    for (size_t i = 0; i < MAILBOX_LANES; ++i) {
+        mailbox_node_t *node = lane_pop(mb, i);
+        if (node != NULL)
+            return node;
+    }
+    return NULL;
+}
+
+size_t mailbox_release(mailbox_t *const mb, size_t processed) {
+    return atomic_fetch_sub_explicit(&mb->state, processed, memory_order_acq_rel) - processed;
+}
@@ -0,0 +1,103 @@
+#ifndef CACTI_MAILBOX_H
+#define CACTI_MAILBOX_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cacheline.h"
+#include "cacti.h"
+#include "stats.h"
+
+typedef struct mailbox_node {
+    struct mailbox_node *_Atomic next;
+    message_t message;
+#ifdef CACTI_STATS
+    long enqueued; // time of the push, see monotonic_nanos()
+#endif
+    _Alignas(max_align_t) unsigned char payload[INLINE_PAYLOAD_LIMIT];
+} mailbox_node_t;
+
+/* The stub node of a lane, which is only ever linked through its next field */
+typedef struct {
+    mailbox_node_t *_Atomic next;
+} mailbox_stub_t;
+
+_Static_assert(offsetof(mailbox_node_t, next) == 0, "a stub is accessed as a node");
+
+/* Lanes of a mailbox, in the order they are drained */
+enum {
+    MAILBOX_CONTROL = 0,
+    MAILBOX_NORMAL = 1,
+    MAILBOX_LANES = 2,
+};
+
+/* Lock-free multi-producer single-consumer mailbox.
+ * Messages are kept in lanes, each of them FIFO; the consumer takes messages
+ * of the control lane first. A lane is an intrusive linked list of messages
+ * (D. Vyukov's MPSC queue). Its producers' and consumer's ends are kept on
+ * separate cache lines, so that a send does not take the line the consumer
+ * is draining from.
+ * The state word counts the messages of all lanes that were accepted and not yet
+ * released by the consumer; the sender which moves it from 0 is responsible for
+ * scheduling the actor, and the consumer which releases the last message
+ * leaves it unscheduled. */
+typedef struct {
+    // written by the producers
+    _Alignas(CACHE_LINE_SIZE) mailbox_node_t *_Atomic heads[MAILBOX_LANES];
+    _Atomic size_t state; // also by the consumer, once per batch of messages
+    size_t limit;
+#ifdef CACTI_STATS
+    _Atomic size_t high_water; // the biggest state so far
+#endif
+    // written by the consumer
+    _Alignas(CACHE_LINE_SIZE) mailbox_node_t *tails[MAILBOX_LANES];
+    mailbox_stub_t stubs[MAILBOX_LANES];
+} mailbox_t;
+
+_Static_assert(offsetof(mailbox_t, tails) - offsetof(mailbox_t, heads) >= CACHE_LINE_SIZE,
+        "the producers' and the consumer's fields have to be on separate cache lines");
+_Static_assert(sizeof(mailbox_t) == 2 * CACHE_LINE_SIZE, "a mailbox takes two cache lines");
+
+void mailbox_init(mailbox_t *const mb, size_t limit);
+
+void mailbox_destroy(mailbox_t *const mb);
+
+/* Puts the message in the given lane.
+ * Returns -1 if the mailbox is full, 0 otherwise. If overflow is set, the message
+ * is accepted even then and 1 is returned if the mailbox is over its limit.
+ * Sets *was_idle if the caller has to schedule the mailbox owner.
+ * If payload is not NULL, message.nbytes (at most INLINE_PAYLOAD_LIMIT) bytes of it
+ * are copied into the mailbox and message.data is set to point at the copy. */
+int mailbox_push(mailbox_t *const mb, size_t lane, message_t message, const void *payload,
+        bool overflow, bool *const was_idle);
+
+/* Pushes n (at least one) messages at once, keeping their order. Without overflow
+ * returns -1 and pushes nothing if there is no room for all of them.
+ * Other results and *was_idle are set as by mailbox_push. */
+int mailbox_push_batch(mailbox_t *const mb, size_t lane, const message_t *const messages,
+        size_t n, bool overflow, bool *const was_idle);
+
+/* Consumer only. Returns NULL if there is no message ready to be taken. This may
+ * happen even though some message was accepted, if its sender has not finished
+ * pushing yet. The node has to be returned with mailbox_node_free once
+ * the message is handled. */
+mailbox_node_t *mailbox_pop(mailbox_t *const mb);
+
+void mailbox_node_free(mailbox_node_t *const node);
+
+/* Consumer only. Marks processed messages as handled, returning the number of
+ * messages still waiting. If it is non-zero, the caller has to reschedule
+ * the mailbox owner. */
+size_t mailbox_release(mailbox_t *const mb, size_t processed);
+
+/* Number of messages accepted and not yet released */
+static inline size_t mailbox_size(mailbox_t *const mb) {
+    return atomic_load_explicit(&mb->state, memory_order_relaxed);
+}
+
+static inline bool mailbox_is_full(mailbox_t *const mb) {
+    return mailbox_size(mb) >= mb->limit;
+}
+
+#endif //CACTI_MAILBOX_H
@@ -1,5 +0,0 @@
-#define TYPE_ message_t
-#define PREFIX_ message
-#include "queue.def"
-#undef TYPE_
-#undef message
\ No newline at end of file
@@ -1,10 +0,0 @@
-#ifndef CACTI_MESSAGE_QUEUE_H
-#define CACTI_MESSAGE_QUEUE_H
-
-#define TYPE_ message_t
-#define PREFIX_ message
-#include "queue.dec"
-#undef TYPE_
-#undef PREFIX_
-
-#endif //CACTI_MESSAGE_QUEUE_H
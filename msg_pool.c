@@ -0,0 +1,221 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "cacti.h"
+#include "msg_pool.h"
+#include "err.h"
+
+#define MIN_CLASS_SHIFT 4 // the smallest class holds 16 bytes
+#define SIZE_CLASSES 9 // the biggest class holds 4 KiB
+#define LARGE_CLASS SIZE_CLASSES // blocks bigger than the biggest class are not pooled
+
+/* Maximal number of free blocks of one class kept by a pool */
+#define CLASS_CACHE_LIMIT 256
+
+/* Number of blocks freed by a foreign thread that are returned at once */
+#define REMOTE_BATCH 32
+
+struct msg_pool;
+
+typedef struct {
+    struct msg_pool *owner;
+    size_t size_class;
+} msg_header_t;
+
+typedef struct msg_block {
+    msg_header_t header;
+    struct msg_block *next; // overlaps the payload, valid only while the block is free
+} msg_block_t;
+
+typedef struct msg_pool {
+    struct msg_pool *next_abandoned;
+    msg_block_t *free[SIZE_CLASSES];
+    size_t nfree[SIZE_CLASSES];
+    _Atomic(msg_block_t *) remote; // blocks returned by other threads
+
+    // Batch of blocks of another pool, freed by the thread owning this one.
+    struct msg_pool *batch_owner;
+    msg_block_t *batch_head;
+    msg_block_t *batch_tail;
+    size_t batch_size;
+} msg_pool_t;
+
+static _Thread_local msg_pool_t *local_pool = NULL;
+
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+
+/* Pools of finished threads, waiting to be adopted */
+static pthread_mutex_t abandoned_lock = PTHREAD_MUTEX_INITIALIZER;
+static msg_pool_t *abandoned = NULL;
+
+static void *payload_of(msg_block_t *const block) {
+    return (char *)block + sizeof(msg_header_t);
+}
+
+static msg_block_t *block_of(void *const payload) {
+    return (msg_block_t *)((char *)payload - sizeof(msg_header_t));
+}
+
+static size_t class_size(size_t size_class) {
+    return (size_t)1 << (size_class + MIN_CLASS_SHIFT);
+}
+
+static size_t size_class_of(size_t size) {
+    size_t size_class = 0;
+    while (size_class < SIZE_CLASSES && class_size(size_class) < size)
+        ++size_class;
+    return size_class;
+}
+
+static void batch_flush(msg_pool_t *const pool) {
+    if (pool->batch_size == 0)
+        return;
+    msg_pool_t *const owner = pool->batch_owner;
+    msg_block_t *head = atomic_load_explicit(&owner->remote, memory_order_relaxed);
+    do {
+        pool->batch_tail->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote, &head, pool->batch_head,
+            memory_order_release, memory_order_relaxed));
+
+    pool->batch_owner = NULL;
+    pool->batch_head = pool->batch_tail = NULL;
+    pool->batch_size = 0;
+}
+
+/* Puts a block of this pool on its free list, or gives it back to malloc
+ * if there are enough free blocks of its class. */
+static void pool_put(msg_pool_t *const pool, msg_block_t *const block) {
+    size_t size_class = block->header.size_class;
+    if (pool->nfree[size_class] == CLASS_CACHE_LIMIT) {
+        free(block);
+        return;
+    }
+    block->next = pool->free[size_class];
+    pool->free[size_class] = block;
+    ++pool->nfree[size_class];
+}
+
+static void pool_collect_remote(msg_pool_t *const pool) {
+    msg_block_t *block = atomic_exchange_explicit(&pool->remote, NULL, memory_order_acquire);
+    while (block != NULL) {
+        msg_block_t *next = block->next;
+        pool_put(pool, block);
+        block = next;
+    }
+}
+
+/* Gives the free blocks of the pool back to malloc. */
+static void pool_trim(msg_pool_t *const pool) {
+    pool_collect_remote(pool);
+    for (size_t size_class = 0; size_class < SIZE_CLASSES; ++size_class) {
+        while (pool->free[size_class] != NULL) {
+            msg_block_t *const block = pool->free[size_class];
+            pool->free[size_class] = block->next;
+            free(block);
+        }
+        pool->nfree[size_class] = 0;
+    }
+}
+
+/* The pool of a finished thread keeps no free blocks, as it may never be adopted.
+ * It cannot be released itself while its blocks are in use elsewhere. */
+static void pool_release(void *data) {
+    int err;
+    msg_pool_t *const pool = data;
+    batch_flush(pool);
+    pool_trim(pool);
+    local_pool = NULL; // the thread may still free payloads in other destructors
+
+    mutex_lock(&abandoned_lock);
+    pool->next_abandoned = abandoned;
+    abandoned = pool;
+    mutex_unlock(&abandoned_lock);
+}
+
+static void pool_key_create() {
+    int err;
+    verify(pthread_key_create(&pool_key, pool_release), "pthread_key_create failed");
+}
+
+static msg_pool_t *pool_acquire() {
+    int err;
+    if (local_pool != NULL)
+        return local_pool;
+
+    pthread_once(&pool_key_once, pool_key_create);
+    mutex_lock(&abandoned_lock);
+    msg_pool_t *pool = abandoned;
+    if (pool != NULL)
+        abandoned = pool->next_abandoned;
+    mutex_unlock(&abandoned_lock);
+
+    if (pool == NULL) {
+        if ((pool = calloc(1, sizeof(msg_pool_t))) == NULL)
+            fatal("calloc failed");
+        atomic_init(&pool->remote, NULL);
+    }
+    verify(pthread_setspecific(pool_key, pool), "pthread_setspecific failed");
+    return local_pool = pool;
+}
+
+void *cacti_msg_alloc(size_t size) {
+    size_t size_class = size_class_of(size);
+    msg_block_t *block;
+
+    if (size_class == LARGE_CLASS) {
+        if ((block = malloc(sizeof(msg_header_t) + size)) == NULL)
+            return NULL;
+        block->header = (msg_header_t){.owner = NULL, .size_class = LARGE_CLASS};
+        return payload_of(block);
+    }
+
+    msg_pool_t *const pool = pool_acquire();
+    if (pool->free[size_class] == NULL &&
+            atomic_load_explicit(&pool->remote, memory_order_relaxed) != NULL)
+        pool_collect_remote(pool);
+
+    if ((block = pool->free[size_class]) != NULL) {
+        pool->free[size_class] = block->next;
+        --pool->nfree[size_class];
+    } else {
+        if ((block = malloc(sizeof(msg_header_t) + class_size(size_class))) == NULL)
+            return NULL;
+        block->header = (msg_header_t){.owner = pool, .size_class = size_class};
+    }
+    return payload_of(block);
+}
+
+void cacti_msg_free(void *ptr) {
+    if (ptr == NULL)
+        return;
+    msg_block_t *const block = block_of(ptr);
+    msg_pool_t *const owner = block->header.owner;
+
+    if (owner == NULL) {
+        free(block);
+        return;
+    }
+    msg_pool_t *const pool = pool_acquire();
+    if (owner == pool) {
+        pool_put(pool, block);
+        return;
+    }
+
+    if (pool->batch_owner != owner) {
+        batch_flush(pool);
+        pool->batch_owner = owner;
+        pool->batch_tail = block;
+    }
+    block->next = pool->batch_head;
+    pool->batch_head = block;
+    if (++pool->batch_size == REMOTE_BATCH)
+        batch_flush(pool);
+}
+
+void msg_pool_flush() {
+    if (local_pool != NULL)
+        batch_flush(local_pool);
+}
@@ -0,0 +1,19 @@
+#ifndef CACTI_MSG_POOL_H
+#define CACTI_MSG_POOL_H
+
+/* Per-thread pools of message payloads (cacti_msg_alloc / cacti_msg_free),
+ * which also hold the nodes of mailboxes.
+ *
+ * Payloads are grouped in power-of-two size classes. Each thread allocates from
+ * its own pool without locking. A payload freed by a thread other than its
+ * owner is put in a batch, which is handed back to the owner's pool at once
+ * with a single CAS. Pools of finished threads are adopted by new ones,
+ * so payloads may outlive the threads that allocated them. A finished thread's
+ * pool gives its free blocks back to malloc; until it is adopted, only the pool
+ * itself and the blocks freed to it afterwards stay allocated, so there are
+ * at most as many such pools as threads ever ran at once. */
+
+/* Returns the blocks batched by the calling thread to their owner. */
+void msg_pool_flush();
+
+#endif //CACTI_MSG_POOL_H
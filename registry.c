@@ -0,0 +1,104 @@
+#include <stdlib.h>
+
+#include "registry.h"
+#include "err.h"
+
+static registry_chunk_t *chunk_alloc() {
+    registry_chunk_t *chunk = malloc(sizeof(registry_chunk_t));
+    if (chunk == NULL)
+        return NULL;
+    for (size_t i = 0; i < REGISTRY_CHUNK_SIZE; ++i) {
+        atomic_init(&chunk->entries[i], NULL);
+        atomic_init(&chunk->flags[i], false);
+    }
+    return chunk;
+}
+
+int registry_init(registry_t *const r, size_t capacity) {
+    atomic_init(&r->size, 0);
+    for (size_t i = 0; i < REGISTRY_CHUNKS; ++i)
+        atomic_init(&r->chunks[i], NULL);
+
+    if (capacity > CAST_LIMIT)
+        capacity = CAST_LIMIT;
+    for (size_t i = 0; i * REGISTRY_CHUNK_SIZE < capacity; ++i) {
+        registry_chunk_t *chunk = chunk_alloc();
+        if (chunk == NULL) {
+            registry_destroy(r);
+            return -1;
+        }
+        atomic_init(&r->chunks[i], chunk);
+    }
+    return 0;
+}
+
+void registry_destroy(registry_t *const r) {
+    for (size_t i = 0; i < REGISTRY_CHUNKS; ++i)
+        free(atomic_load_explicit(&r->chunks[i], memory_order_relaxed));
+}
+
+void registry_clear(registry_t *const r) {
+    size_t size = atomic_load_explicit(&r->size, memory_order_relaxed);
+    for (size_t i = 0; i < size; i += REGISTRY_CHUNK_SIZE) {
+        registry_chunk_t *chunk = atomic_load_explicit(&r->chunks[i / REGISTRY_CHUNK_SIZE],
+                memory_order_relaxed);
+        if (chunk == NULL)
+            continue;
+        for (size_t j = 0; j < REGISTRY_CHUNK_SIZE; ++j) {
+            atomic_store_explicit(&chunk->entries[j], NULL, memory_order_relaxed);
+            atomic_store_explicit(&chunk->flags[j], false, memory_order_relaxed);
+        }
+    }
+    atomic_store_explicit(&r->size, 0, memory_order_relaxed);
+}
+
+actor_id_t registry_reserve(registry_t *const r) {
+    size_t size = atomic_load_explicit(&r->size, memory_order_relaxed);
+    do {
+        if (size == CAST_LIMIT)
+            return -1;
+    } while (!atomic_compare_exchange_weak_explicit(&r->size, &size, size + 1,
+            memory_order_acq_rel, memory_order_relaxed));
+    return (actor_id_t)size;
+}
+
+/* Returns the chunk of the reserved id, allocating it if needed. */
+static registry_chunk_t *chunk_of(registry_t *const r, actor_id_t id) {
+    registry_chunk_t *_Atomic *const slot = &r->chunks[id / REGISTRY_CHUNK_SIZE];
+    registry_chunk_t *chunk = atomic_load_explicit(slot, memory_order_acquire);
+
+    if (chunk == NULL) {
+        // Spawners racing for the same chunk - the loser frees its copy.
+        registry_chunk_t *new_chunk = chunk_alloc();
+        if (new_chunk == NULL)
+            fatal("malloc failed");
+        if (atomic_compare_exchange_strong_explicit(slot, &chunk, new_chunk,
+                memory_order_acq_rel, memory_order_acquire))
+            chunk = new_chunk;
+        else
+            free(new_chunk);
+    }
+    return chunk;
+}
+
+void registry_publish(registry_t *const r, actor_id_t id, void *const entry) {
+    atomic_store_explicit(&chunk_of(r, id)->entries[id % REGISTRY_CHUNK_SIZE], entry,
+            memory_order_release);
+}
+
+atomic_bool *registry_flag(registry_t *const r, actor_id_t id) {
+    return &chunk_of(r, id)->flags[id % REGISTRY_CHUNK_SIZE];
+}
+
+void registry_flag_all(registry_t *const r) {
+    size_t size = atomic_load_explicit(&r->size, memory_order_acquire);
+    for (size_t i = 0; i < size; i += REGISTRY_CHUNK_SIZE) {
+        registry_chunk_t *chunk = atomic_load_explicit(&r->chunks[i / REGISTRY_CHUNK_SIZE],
+                memory_order_acquire);
+        if (chunk == NULL)
+            continue; // the flags of a chunk allocated later are false
+        size_t n = size - i < REGISTRY_CHUNK_SIZE ? size - i : REGISTRY_CHUNK_SIZE;
+        for (size_t j = 0; j < n; ++j)
+            atomic_store_explicit(&chunk->flags[j], true, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef CACTI_REGISTRY_H
+#define CACTI_REGISTRY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cacti.h"
+#include "cacheline.h"
+
+/* Number of entries in one chunk of the registry. Must be a power of two. */
+#ifndef REGISTRY_CHUNK_SIZE
+#define REGISTRY_CHUNK_SIZE 1024
+#endif
+
+#define REGISTRY_CHUNKS ((CAST_LIMIT + REGISTRY_CHUNK_SIZE - 1) / REGISTRY_CHUNK_SIZE)
+
+/* Flags of the entries are kept apart from them, so that the flags of all the entries
+ * can be set in one pass over dense arrays. */
+typedef struct {
+    void *_Atomic entries[REGISTRY_CHUNK_SIZE];
+    atomic_bool flags[REGISTRY_CHUNK_SIZE];
+} registry_chunk_t;
+
+/* Registry of actors, indexed by actor_id_t.
+ * It is a two-level directory: chunks are allocated on demand and never move
+ * or get freed before the registry is destroyed, so lookups take no locks. */
+typedef struct {
+    _Atomic size_t size; // number of reserved ids, apart from the directory read by lookups
+    _Alignas(CACHE_LINE_SIZE) registry_chunk_t *_Atomic chunks[REGISTRY_CHUNKS];
+} registry_t;
+
+/* Preallocates chunks for capacity entries. Returns -1 if malloc fails. */
+int registry_init(registry_t *const r, size_t capacity);
+
+/* Frees the chunks, but not the entries. */
+void registry_destroy(registry_t *const r);
+
+/* Forgets all the entries, flags and ids, but keeps the chunks. */
+void registry_clear(registry_t *const r);
+
+/* Returns a new id, or -1 if CAST_LIMIT ids were already reserved. */
+actor_id_t registry_reserve(registry_t *const r);
+
+/* Makes entry visible under the reserved id. */
+void registry_publish(registry_t *const r, actor_id_t id, void *const entry);
+
+/* Returns the flag of the reserved id, which stays at the same address until the registry
+ * is cleared. The flags are initially false. */
+atomic_bool *registry_flag(registry_t *const r, actor_id_t id);
+
+/* Sets the flags of all the reserved ids. Allocates nothing and takes no locks,
+ * so it may be called by a signal handler. */
+void registry_flag_all(registry_t *const r);
+
+/* Returns the entry with the given id, or NULL if it was not published. */
+static inline void *registry_get(registry_t *const r, actor_id_t id) {
+    if (id < 0 || id >= CAST_LIMIT)
+        return NULL;
+    registry_chunk_t *chunk = atomic_load_explicit(&r->chunks[id / REGISTRY_CHUNK_SIZE],
+            memory_order_acquire);
+    if (chunk == NULL)
+        return NULL;
+    return atomic_load_explicit(&chunk->entries[id % REGISTRY_CHUNK_SIZE], memory_order_acquire);
+}
+
+static inline size_t registry_size(registry_t *const r) {
+    return atomic_load_explicit(&r->size, memory_order_acquire);
+}
+
+#endif //CACTI_REGISTRY_H
@@ -0,0 +1,88 @@
+#include "run_queue.h"
+
+/* The algorithm follows the local run queue of the Go scheduler:
+ * head is advanced with CAS by whoever takes elements, tail is written
+ * by the owner only. */
+
+#define MASK (RUN_QUEUE_CAPACITY - 1)
+
+_Static_assert((RUN_QUEUE_CAPACITY & MASK) == 0, "RUN_QUEUE_CAPACITY must be a power of two");
+
+void run_queue_init(run_queue_t *const q) {
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->next, RUN_QUEUE_NONE);
+    for (size_t i = 0; i < RUN_QUEUE_CAPACITY; ++i)
+        atomic_init(&q->buffer[i], 0);
+}
+
+bool run_queue_push(run_queue_t *const q, actor_id_t actor) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail - head >= RUN_QUEUE_CAPACITY)
+        return false;
+
+    atomic_store_explicit(&q->buffer[tail & MASK], actor, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool run_queue_pop(run_queue_t *const q, actor_id_t *const actor) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    while (true) {
+        size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        if (head == tail)
+            return false;
+        *actor = atomic_load_explicit(&q->buffer[head & MASK], memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&q->head, &head, head + 1,
+                memory_order_acq_rel, memory_order_acquire))
+            return true;
+    }
+}
+
+/* Copies half of q's contents to out and commits it by advancing head.
+ * Returns the number of grabbed elements. */
+static size_t grab(run_queue_t *const q, _Atomic actor_id_t *const out, size_t out_tail) {
+    while (true) {
+        size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+        size_t n = tail - head;
+        n -= n / 2;
+        if (n == 0)
+            return 0;
+        if (n > RUN_QUEUE_CAPACITY / 2)
+            continue; // inconsistent head and tail, retry
+
+        for (size_t i = 0; i < n; ++i) {
+            actor_id_t actor = atomic_load_explicit(&q->buffer[(head + i) & MASK],
+                    memory_order_relaxed);
+            atomic_store_explicit(&out[(out_tail + i) & MASK], actor, memory_order_relaxed);
+        }
+        if (atomic_compare_exchange_strong_explicit(&q->head, &head, head + n,
+                memory_order_acq_rel, memory_order_acquire))
+            return n;
+    }
+}
+
+size_t run_queue_grab_half(run_queue_t *const q, actor_id_t *const out) {
+    _Atomic actor_id_t tmp[RUN_QUEUE_CAPACITY];
+    size_t n = grab(q, tmp, 0);
+    for (size_t i = 0; i < n; ++i)
+        out[i] = atomic_load_explicit(&tmp[i], memory_order_relaxed);
+    return n;
+}
+
+bool run_queue_steal(run_queue_t *const victim, run_queue_t *const thief,
+        actor_id_t *const actor) {
+    size_t tail = atomic_load_explicit(&thief->tail, memory_order_relaxed);
+    size_t n = grab(victim, thief->buffer, tail);
+    if (n == 0)
+        return false;
+
+    // the last stolen element is run right away instead of being queued
+    --n;
+    *actor = atomic_load_explicit(&thief->buffer[(tail + n) & MASK], memory_order_relaxed);
+    if (n > 0)
+        atomic_store_explicit(&thief->tail, tail + n, memory_order_release);
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef CACTI_RUN_QUEUE_H
+#define CACTI_RUN_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cacti.h"
+
+/* Capacity of a single worker's run queue. Must be a power of two. */
+#ifndef RUN_QUEUE_CAPACITY
+#define RUN_QUEUE_CAPACITY 256
+#endif
+
+/* Marks an empty next slot */
+#define RUN_QUEUE_NONE ((actor_id_t)-1)
+
+/* Bounded per-worker queue of ready actors.
+ * Only the owning worker pushes (at tail) and pops (from head); other workers
+ * may steal from head concurrently. Neither operation takes a lock.
+ * Besides, the queue has a slot for the actor to be run next, before the others. */
+typedef struct {
+    _Atomic size_t head;
+    _Atomic size_t tail;
+    _Atomic actor_id_t next;
+    _Atomic actor_id_t buffer[RUN_QUEUE_CAPACITY];
+} run_queue_t;
+
+void run_queue_init(run_queue_t *const q);
+
+/* Owner only. Returns false if the queue is full. */
+bool run_queue_push(run_queue_t *const q, actor_id_t actor);
+
+/* Owner only. Returns false if the queue is empty. */
+bool run_queue_pop(run_queue_t *const q, actor_id_t *const actor);
+
+/* Owner only. Moves half of the queue's contents to out (which must hold
+ * RUN_QUEUE_CAPACITY / 2 elements), returning the number of moved elements. */
+size_t run_queue_grab_half(run_queue_t *const q, actor_id_t *const out);
+
+/* Called by the owner of thief. Moves half of victim's contents to thief,
+ * returning one of them in actor. Returns false if there was nothing to steal.
+ * The thief queue must be empty. */
+bool run_queue_steal(run_queue_t *const victim, run_queue_t *const thief,
+        actor_id_t *const actor);
+
+/* Owner only. Puts the actor in the next slot, returning the actor it displaced
+ * or RUN_QUEUE_NONE. */
+static inline actor_id_t run_queue_swap_next(run_queue_t *const q, actor_id_t actor) {
+    return atomic_exchange_explicit(&q->next, actor, memory_order_acq_rel);
+}
+
+/* Takes the actor from the next slot. May be called by any thread.
+ * Returns false if the slot is empty. */
+static inline bool run_queue_take_next(run_queue_t *const q, actor_id_t *const actor) {
+    if (atomic_load_explicit(&q->next, memory_order_relaxed) == RUN_QUEUE_NONE)
+        return false;
+    actor_id_t next = atomic_exchange_explicit(&q->next, RUN_QUEUE_NONE, memory_order_acq_rel);
+    if (next == RUN_QUEUE_NONE)
+        return false;
+    *actor = next;
+    return true;
+}
+
+static inline bool run_queue_has_next(run_queue_t *const q) {
+    return atomic_load_explicit(&q->next, memory_order_acquire) != RUN_QUEUE_NONE;
+}
+
+/* The number of actors in the queue, not counting the next slot */
+static inline size_t run_queue_size(run_queue_t *const q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    // head may be stale relative to tail, so the difference is clamped
+    return tail - head <= RUN_QUEUE_CAPACITY ? tail - head : RUN_QUEUE_CAPACITY;
+}
+
+static inline bool run_queue_is_empty(run_queue_t *const q) {
+    return run_queue_size(q) == 0;
+}
+
+#endif //CACTI_RUN_QUEUE_H
@@ -7,17 +7,20 @@ typedef struct factorial {
     int n;
     int k;
     long long k_fact;
+    cacti_future_t *future; // of main, waiting for n!
 } fact_t;
 
 const int MSG_COMP = 0x1;
 const int MSG_PASS = 0x2;
+const int MSG_START = 0x3;
 
 void hello(void **stateptr, size_t nbytes, void *data);
 void compute(fact_t **stateptr, size_t nbytes, fact_t *data);
 void pass(void **stateptr, size_t nbytes, void *data);
+void start(void **stateptr, size_t nbytes, cacti_request_t *data);
 
 role_t role;
-act_t prompts[] = {hello, (act_t)compute, pass};
+act_t prompts[] = {hello, (act_t)compute, pass, (act_t)start};
 
 void hello(__attribute__((unused)) void **stateptr,
         __attribute__((unused)) size_t nbytes, void *data) {
@@ -34,13 +37,13 @@ void compute(fact_t **stateptr, __attribute__((unused)) size_t nbytes, fact_t *d
     (*stateptr)->n = data->n;
     (*stateptr)->k = data->k + 1;
     (*stateptr)->k_fact = data->k_fact * (*stateptr)->k;
-    free(data);
+    (*stateptr)->future = data->future;
     debug(printf("Factorial computed in actor %ld is %lld\n", actor_id_self(),
             (*stateptr)->k_fact));
 
     if ((*stateptr)->k == (*stateptr)->n) {
-        // print and clean
-        printf("%lld\n", (*stateptr)->k_fact);
+        // answer and clean
+        cacti_reply((*stateptr)->future, (void *)(long)(*stateptr)->k_fact);
         free(*stateptr);
         send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
     } else {
@@ -49,9 +52,15 @@ void compute(fact_t **stateptr, __attribute__((unused)) size_t nbytes, fact_t *d
     }
 }
 
+/* The leader gets n from main. */
+void start(void **stateptr, __attribute__((unused)) size_t nbytes, cacti_request_t *data) {
+    fact_t initial = {.n = (int)(long)data->data, .k = 0, .k_fact = 1, .future = data->future};
+    compute((fact_t **)stateptr, sizeof(fact_t), &initial);
+}
+
 void pass(void **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
-    send_message((actor_id_t)data, (message_t)
-            {.message_type = MSG_COMP, .nbytes = sizeof(fact_t), .data = *stateptr});
+    send_message_inline((actor_id_t)data, MSG_COMP, *stateptr, sizeof(fact_t));
+    free(*stateptr);
 
     send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
 }
@@ -73,14 +82,16 @@ int main() {
         exit(1);
     }
 
-    fact_t *initial = malloc(sizeof(fact_t));
-    if (!initial)
-        fatal("malloc failed");
-    *initial = (fact_t){.n = n, .k = 0, .k_fact = 1};
+    cacti_future_t *future;
+    void *result;
     if (actor_system_create(&leader, &role) != 0)
         fatal("failed to create actor system");
-    send_message(leader, (message_t)
-    {.message_type = MSG_COMP, .nbytes = sizeof(role_t), initial});
+    if (send_request(leader, MSG_START, (void *)(long)n, &future) != 0)
+        fatal("failed to send the request");
+    if (cacti_future_wait(future, &result) != 0)
+        fatal("no factorial computed");
+    cacti_future_free(future);
+    printf("%lld\n", (long long)(long)result);
 
     actor_system_join(leader);
 
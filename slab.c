@@ -0,0 +1,83 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "slab.h"
+#include "topology.h"
+#include "err.h"
+
+/* The slab header takes the first cache line, so blocks stay aligned. */
+#define SLAB_HEADER_SIZE CACHE_LINE_SIZE
+
+_Static_assert(sizeof(slab_t) <= SLAB_HEADER_SIZE, "slab header does not fit");
+
+void slab_allocator_init(slab_allocator_t *const a, size_t block_size, int node) {
+    a->block_size = (block_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    a->node = node;
+    a->next = NULL;
+    a->end = NULL;
+    a->slabs = NULL;
+    a->spare = NULL;
+}
+
+static void slabs_free(slab_allocator_t *const a, slab_t *slab) {
+    while (slab != NULL) {
+        slab_t *next = slab->next;
+        if (a->node >= 0)
+            topology_free(slab, slab->size);
+        else
+            free(slab);
+        slab = next;
+    }
+}
+
+void slab_allocator_destroy(slab_allocator_t *const a) {
+    slabs_free(a, a->slabs);
+    slabs_free(a, a->spare);
+    a->slabs = NULL;
+    a->spare = NULL;
+    a->next = NULL;
+    a->end = NULL;
+}
+
+void slab_allocator_reset(slab_allocator_t *const a) {
+    while (a->slabs != NULL) {
+        slab_t *next = a->slabs->next;
+        a->slabs->next = a->spare;
+        a->spare = a->slabs;
+        a->slabs = next;
+    }
+    a->next = NULL;
+    a->end = NULL;
+}
+
+static void slab_refill(slab_allocator_t *const a) {
+    slab_t *slab = a->spare;
+    size_t size = slab != NULL ? slab->size : SLAB_SIZE;
+    if (size < SLAB_HEADER_SIZE + a->block_size)
+        size = SLAB_HEADER_SIZE + a->block_size;
+
+    if (slab != NULL)
+        a->spare = slab->next;
+    else if (a->node >= 0) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size = (size + page - 1) / page * page;
+        if ((slab = topology_alloc_on_node(size, a->node)) == NULL)
+            fatal("mmap failed");
+    } else if ((slab = aligned_alloc(CACHE_LINE_SIZE, size)) == NULL)
+        fatal("aligned_alloc failed");
+    slab->next = a->slabs;
+    slab->size = size;
+    a->slabs = slab;
+    a->next = (char *)slab + SLAB_HEADER_SIZE;
+    a->end = (char *)slab + size;
+}
+
+void *slab_alloc(slab_allocator_t *const a) {
+    if (a->next == NULL || (size_t)(a->end - a->next) < a->block_size)
+        slab_refill(a);
+    void *block = a->next;
+    a->next += a->block_size;
+    return block;
+}
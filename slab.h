@@ -0,0 +1,40 @@
+#ifndef CACTI_SLAB_H
+#define CACTI_SLAB_H
+
+#include <stddef.h>
+
+#include "cacheline.h"
+
+/* Size of memory obtained at once by a slab allocator */
+#ifndef SLAB_SIZE
+#define SLAB_SIZE (64 * 1024)
+#endif
+
+typedef struct slab {
+    struct slab *next;
+    size_t size;
+} slab_t;
+
+/* Bump allocator of cache-line-aligned blocks of one size.
+ * Blocks are not freed one by one - all of them are released together
+ * when the allocator is destroyed, or given back for reuse when it is reset.
+ * Not thread-safe, meant to be owned by a single worker. */
+typedef struct {
+    size_t block_size;
+    int node; // NUMA node the slabs are allocated on, -1 for any
+    char *next;
+    char *end;
+    slab_t *slabs;
+    slab_t *spare; // slabs given back by slab_allocator_reset, used before new ones
+} slab_allocator_t;
+
+void slab_allocator_init(slab_allocator_t *const a, size_t block_size, int node);
+
+void slab_allocator_destroy(slab_allocator_t *const a);
+
+/* Frees all the blocks at once, but keeps the memory for new ones. */
+void slab_allocator_reset(slab_allocator_t *const a);
+
+void *slab_alloc(slab_allocator_t *const a);
+
+#endif //CACTI_SLAB_H
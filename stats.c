@@ -0,0 +1,80 @@
+#include "stats.h"
+
+/* The histogram is log-linear: values below CACTI_LATENCY_SUB_BUCKETS have
+ * a bucket each, and every further power of two is split into
+ * CACTI_LATENCY_SUB_BUCKETS equal buckets, so the error is bounded by 1/8. */
+#define SUB_BUCKETS_SHIFT 3
+
+_Static_assert(CACTI_LATENCY_SUB_BUCKETS == 1 << SUB_BUCKETS_SHIFT,
+        "sub-buckets have to match their shift");
+
+static size_t bucket_of(long nanos) {
+    unsigned long value = nanos > 0 ? (unsigned long)nanos : 0;
+    if (value < CACTI_LATENCY_SUB_BUCKETS)
+        return value;
+
+    size_t exponent = 8 * sizeof(unsigned long) - 1 - __builtin_clzl(value);
+    size_t sub = (value >> (exponent - SUB_BUCKETS_SHIFT)) & (CACTI_LATENCY_SUB_BUCKETS - 1);
+    size_t bucket = (exponent - SUB_BUCKETS_SHIFT + 1) * CACTI_LATENCY_SUB_BUCKETS + sub;
+    return bucket < CACTI_LATENCY_BUCKETS ? bucket : CACTI_LATENCY_BUCKETS - 1;
+}
+
+/* The smallest value counted in the bucket */
+static long bucket_floor(size_t bucket) {
+    if (bucket < CACTI_LATENCY_SUB_BUCKETS)
+        return (long)bucket;
+    size_t exponent = bucket / CACTI_LATENCY_SUB_BUCKETS - 1 + SUB_BUCKETS_SHIFT;
+    size_t sub = bucket % CACTI_LATENCY_SUB_BUCKETS;
+    return (long)((CACTI_LATENCY_SUB_BUCKETS + sub) << (exponent - SUB_BUCKETS_SHIFT));
+}
+
+void worker_stats_init(worker_stats_t *const stats) {
+    atomic_init(&stats->messages_sent, 0);
+    atomic_init(&stats->messages_processed, 0);
+    atomic_init(&stats->steals, 0);
+    atomic_init(&stats->parks, 0);
+    atomic_init(&stats->spawned, 0);
+    atomic_init(&stats->died, 0);
+    atomic_init(&stats->run_queue_high_water, 0);
+    for (size_t i = 0; i < CACTI_LATENCY_BUCKETS; ++i)
+        atomic_init(&stats->latency[i], 0);
+}
+
+void worker_stats_latency(worker_stats_t *const stats, long nanos) {
+    stat_add(&stats->latency[bucket_of(nanos)], 1);
+}
+
+void worker_stats_read(worker_stats_t *const stats, cacti_worker_stats_t *const out,
+        unsigned long *const latency) {
+    out->messages_sent = stat_read(&stats->messages_sent);
+    out->messages_processed = stat_read(&stats->messages_processed);
+    out->steals = stat_read(&stats->steals);
+    out->parks = stat_read(&stats->parks);
+    out->spawned = stat_read(&stats->spawned);
+    out->died = stat_read(&stats->died);
+    out->run_queue_high_water = atomic_load_explicit(&stats->run_queue_high_water,
+            memory_order_relaxed);
+    for (size_t i = 0; i < CACTI_LATENCY_BUCKETS; ++i)
+        latency[i] += stat_read(&stats->latency[i]);
+}
+
+long cacti_stats_latency_percentile(const cacti_stats_t *stats, double percentile) {
+    unsigned long total = 0;
+    for (size_t i = 0; i < CACTI_LATENCY_BUCKETS; ++i)
+        total += stats->latency[i];
+    if (total == 0)
+        return -1;
+
+    // The rank of the wanted sample, counting from 1
+    unsigned long rank = (unsigned long)(percentile / 100.0 * (double)total + 0.5);
+    if (rank == 0)
+        rank = 1;
+    if (rank > total)
+        rank = total;
+
+    unsigned long seen = 0;
+    size_t bucket = 0;
+    while ((seen += stats->latency[bucket]) < rank)
+        ++bucket;
+    return bucket + 1 < CACTI_LATENCY_BUCKETS ? bucket_floor(bucket + 1) - 1 : bucket_floor(bucket);
+}
@@ -0,0 +1,62 @@
+#ifndef CACTI_STATS_H
+#define CACTI_STATS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "cacti.h"
+#include "clock.h"
+
+/* Runtime statistics, collected only if CACTI_STATS is defined.
+ * Each counter is bumped by a single thread, so it needs no atomic
+ * read-modify-write; other threads only read it to take a snapshot. */
+
+#ifdef CACTI_STATS
+#define stats(action) \
+do { \
+    action; \
+} while (0)
+#else
+#define stats(action)
+#endif
+
+typedef _Atomic unsigned long stat_counter_t;
+
+static inline void stat_add(stat_counter_t *const counter, unsigned long n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+            memory_order_relaxed);
+}
+
+static inline unsigned long stat_read(stat_counter_t *const counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+/* Raises the shared maximum to value, if it is lower. */
+static inline void stat_max(_Atomic size_t *const max, size_t value) {
+    size_t curr = atomic_load_explicit(max, memory_order_relaxed);
+    while (curr < value && !atomic_compare_exchange_weak_explicit(max, &curr, value,
+            memory_order_relaxed, memory_order_relaxed));
+}
+
+/* Counters of one worker thread */
+typedef struct {
+    stat_counter_t messages_sent;
+    stat_counter_t messages_processed;
+    stat_counter_t steals;
+    stat_counter_t parks;
+    stat_counter_t spawned;
+    stat_counter_t died;
+    _Atomic size_t run_queue_high_water;
+    stat_counter_t latency[CACTI_LATENCY_BUCKETS];
+} worker_stats_t;
+
+void worker_stats_init(worker_stats_t *const stats);
+
+/* Records the time between enqueuing a message and starting to handle it. */
+void worker_stats_latency(worker_stats_t *const stats, long nanos);
+
+/* Copies the counters to out and adds the latency histogram to latency. */
+void worker_stats_read(worker_stats_t *const stats, cacti_worker_stats_t *const out,
+        unsigned long *const latency);
+
+#endif //CACTI_STATS_H
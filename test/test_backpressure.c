@@ -0,0 +1,140 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define BATCH 5
+
+const int MSG_WORK = 1;
+
+int tests_run = 0;
+
+static actor_id_t receiver;
+static sem_t entered, gate, sent;
+static _Atomic long received;
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void work(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, work};
+role_t role = {.nprompts = 2, .prompts = prompts};
+
+void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+}
+
+/* The first message holds the only worker until the gate is opened. */
+void work(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    ++received;
+    if (data != NULL) {
+        sem_post(&entered);
+        sem_wait(&gate);
+    }
+}
+
+static const message_t job = {.message_type = MSG_WORK};
+
+/* Blocks the receiver with one message and queues the given number behind it.
+ * Returns -1 on failure. */
+static int fill(long queued) {
+    actor_system_config_t config = {.pool_size = 1};
+    received = 0;
+    if (actor_system_create_ex(&receiver, &role, &config) != 0)
+        return -1;
+    if (send_message(receiver, (message_t){.message_type = MSG_WORK, .data = (void *)1}) != 0)
+        return -1;
+    sem_wait(&entered);
+    for (long i = 0; i < queued; ++i) {
+        if (try_send_message(receiver, job) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    size_t n;
+    atomic_int result; // of the send, valid once sent is posted
+} sender_t;
+
+static void *send_batch(void *data) {
+    sender_t *sender = data;
+    message_t msgs[BATCH];
+    for (size_t i = 0; i < sender->n; ++i)
+        msgs[i] = job;
+    atomic_store(&sender->result, sender->n == 1 ? send_message(receiver, msgs[0])
+            : send_messages(receiver, msgs, sender->n));
+    sem_post(&sent);
+    return NULL;
+}
+
+/* Lets the receiver go and checks that the sender, which cannot get through until
+ * then, is released. */
+static char *release(size_t n, long queued) {
+    sender_t sender = {.n = n};
+    atomic_init(&sender.result, 1);
+    pthread_t thread;
+    mu_assert("sender not created", pthread_create(&thread, NULL, send_batch, &sender) == 0);
+    // while the receiver is held, there is no room for the sender
+    mu_assert("sender returned while the mailbox was full",
+            sem_trywait(&sent) == -1 && atomic_load(&sender.result) == 1);
+
+    sem_post(&gate);
+    sem_wait(&sent);
+    mu_assert("sender not released", atomic_load(&sender.result) == 0);
+    pthread_join(thread, NULL);
+    send_message(receiver, (message_t){.message_type = MSG_GODIE});
+    actor_system_join(receiver);
+    mu_assert("messages lost", received == 1 + queued + (long)n);
+    return 0;
+}
+
+/* The message being handled takes room until the end of the receiver's turn. */
+static char *full()
+{
+    long queued = ACTOR_QUEUE_LIMIT - 1;
+    mu_assert("mailbox not filled", fill(queued) == 0);
+    mu_assert("full mailbox took a message", try_send_message(receiver, job) == -3);
+    return release(1, queued);
+}
+
+/* A batch which does not fit in the room left waits until the receiver takes
+ * enough messages, even if they are fewer than the limit. */
+static char *batch()
+{
+    long queued = ACTOR_QUEUE_LIMIT - 2;
+    mu_assert("mailbox not filled", fill(queued) == 0);
+    return release(BATCH, queued);
+}
+
+static char *all_tests()
+{
+    mu_assert("semaphores not created",
+            sem_init(&entered, 0, 0) == 0 && sem_init(&gate, 0, 0) == 0 &&
+            sem_init(&sent, 0, 0) == 0);
+    mu_run_test(full);
+    mu_run_test(batch);
+    sem_destroy(&sent);
+    sem_destroy(&gate);
+    sem_destroy(&entered);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,166 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define BATCHES 50
+#define BATCH 100
+#define CHILDREN 2
+
+const int MSG_COUNT = 1;
+const int MSG_REPORT = 2;
+const int MSG_CAST = 3;
+
+int tests_run = 0;
+
+static actor_id_t children[CHILDREN];
+static size_t reported;
+static atomic_bool ready;
+static long next_count, counted, disorder; // by the leader only
+static _Atomic long casts; // by any actor
+static message_t msgs[ACTOR_QUEUE_LIMIT + 1];
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void count(void **stateptr, size_t nbytes, void *data);
+void report(void **stateptr, size_t nbytes, void *data);
+void cast(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, count, report, cast};
+role_t role = {.nprompts = 4, .prompts = prompts};
+
+/* The leader spawns the children, which report to it. */
+void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    actor_id_t parent = (actor_id_t)data;
+    if (parent == -1) {
+        for (int i = 0; i < CHILDREN; ++i)
+            send_message(actor_id_self(), (message_t){.message_type = MSG_SPAWN, .data = &role});
+        return;
+    }
+    send_message(parent, (message_t){.message_type = MSG_REPORT, .data = (void *)actor_id_self()});
+}
+
+void count(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    if ((long)data != next_count)
+        ++disorder;
+    next_count = (long)data + 1;
+    ++counted;
+}
+
+void report(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    children[reported++] = (actor_id_t)data;
+    if (reported == CHILDREN)
+        atomic_store(&ready, true);
+}
+
+void cast(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    ++casts;
+}
+
+static void godie(actor_id_t actor) {
+    send_message(actor, (message_t){.message_type = MSG_GODIE});
+}
+
+/* Batches are received in order, also when the sender has to wait for room. */
+static char *order()
+{
+    actor_id_t leader;
+    next_count = counted = disorder = 0;
+    mu_assert("system not created", actor_system_create(&leader, &role) == 0);
+    for (long b = 0; b < BATCHES; ++b) {
+        for (long i = 0; i < BATCH; ++i)
+            msgs[i] = (message_t){.message_type = MSG_COUNT, .data = (void *)(b * BATCH + i)};
+        mu_assert("batch not sent", send_messages(leader, msgs, BATCH) == 0);
+    }
+    godie(leader);
+    actor_system_join(leader);
+    mu_assert("messages lost", counted == BATCHES * BATCH);
+    mu_assert("messages out of order", disorder == 0);
+    return 0;
+}
+
+/* A batch which is not accepted leaves nothing in the mailbox. */
+static char *all_or_none()
+{
+    actor_id_t leader;
+    next_count = counted = disorder = 0;
+    mu_assert("system not created", actor_system_create(&leader, &role) == 0);
+    for (long i = 0; i < ACTOR_QUEUE_LIMIT + 1; ++i)
+        msgs[i] = (message_t){.message_type = MSG_COUNT, .data = (void *)i};
+    mu_assert("oversized batch accepted",
+            send_messages(leader, msgs, ACTOR_QUEUE_LIMIT + 1) == -3);
+    mu_assert("batch to a missing actor accepted",
+            send_messages(leader + CAST_LIMIT / 2, msgs, BATCH) == -2);
+    mu_assert("empty batch rejected", send_messages(leader, msgs, 0) == 0);
+
+    godie(leader);
+    actor_system_join(leader);
+    mu_assert("rejected batch received", counted == 0);
+    return 0;
+}
+
+/* A multicast reaches the live targets and reports the last one it did not. */
+static char *multicast()
+{
+    actor_id_t leader;
+    reported = 0;
+    casts = 0;
+    atomic_store(&ready, false);
+    mu_assert("system not created", actor_system_create(&leader, &role) == 0);
+    send_message(leader, (message_t){.message_type = MSG_HELLO, .data = (void *)-1L});
+    while (!atomic_load(&ready))
+        sched_yield();
+
+    godie(children[1]);
+    for (long i = 0; i < BATCH; ++i)
+        msgs[i] = (message_t){.message_type = MSG_CAST};
+    int result;
+    while ((result = send_messages(children[1], msgs, BATCH)) == 0)
+        sched_yield();
+    mu_assert("batch to a dead actor accepted", result == -1);
+
+    message_t msg = {.message_type = MSG_CAST};
+    actor_id_t missing = leader + CAST_LIMIT / 2;
+    actor_id_t some_dead[] = {leader, children[0], children[1], missing};
+    mu_assert("missing target not reported", send_multicast(some_dead, 4, msg) == -2);
+    actor_id_t dead_first[] = {children[1], leader};
+    mu_assert("dead target not reported", send_multicast(dead_first, 2, msg) == -1);
+    actor_id_t alive[] = {leader, children[0]};
+    mu_assert("live targets not reached", send_multicast(alive, 2, msg) == 0);
+
+    godie(children[0]);
+    godie(leader);
+    actor_system_join(leader);
+    // the batches accepted before the actor died are received as whole ones
+    mu_assert("live targets skipped", casts >= 5 && (casts - 5) % BATCH == 0);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(order);
+    mu_run_test(all_or_none);
+    mu_run_test(multicast);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,101 @@
+#define _GNU_SOURCE
+
+#include "minunit.h"
+#include "cacti.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+int tests_run = 0;
+
+static cpu_set_t worker_cpus;
+static int affinity_read;
+
+void hello(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello};
+role_t role = {.nprompts = 1, .prompts = prompts};
+
+/* The leader notes the CPUs its worker may run on and ends the system. */
+void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    affinity_read = pthread_getaffinity_np(pthread_self(), sizeof(worker_cpus), &worker_cpus);
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+static int run(const actor_system_config_t *const config) {
+    actor_id_t leader;
+    affinity_read = -1;
+    CPU_ZERO(&worker_cpus);
+    if (actor_system_create_ex(&leader, &role, config) != 0)
+        return -1;
+    send_message(leader, (message_t){.message_type = MSG_HELLO});
+    actor_system_join(leader);
+    return affinity_read;
+}
+
+static char *rejected()
+{
+    actor_id_t leader;
+    int cpus[] = {0, 0};
+    actor_system_config_t config = {.cpu_affinity = cpus};
+    mu_assert("affinity of unknown length accepted",
+            actor_system_create_ex(&leader, &role, &config) == -1);
+
+    config.pool_size = 2;
+    cpus[1] = CPU_SETSIZE;
+    mu_assert("CPU out of range accepted", actor_system_create_ex(&leader, &role, &config) == -1);
+    cpus[1] = -2;
+    mu_assert("negative CPU accepted", actor_system_create_ex(&leader, &role, &config) == -1);
+
+    config = (actor_system_config_t){.pool_size = 1, .stack_size = 1};
+    mu_assert("tiny stack accepted", actor_system_create_ex(&leader, &role, &config) == -1);
+
+    // a rejected configuration leaves the default system's slot free
+    mu_assert("default configuration rejected", run(NULL) == 0);
+    return 0;
+}
+
+static char *pinned()
+{
+    cpu_set_t allowed;
+    mu_assert("affinity not read", sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed))
+        ++cpu;
+    int first = cpu;
+    actor_system_config_t config = {.pool_size = 1, .cpu_affinity = &cpu};
+    mu_assert("system not run", run(&config) == 0);
+    mu_assert("worker not pinned",
+            CPU_COUNT(&worker_cpus) == 1 && CPU_ISSET(first, &worker_cpus));
+
+    // -1 leaves the worker where the process may run
+    cpu = -1;
+    mu_assert("system not run", run(&config) == 0);
+    mu_assert("unpinned worker restricted", CPU_EQUAL(&worker_cpus, &allowed));
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(rejected);
+    mu_run_test(pinned);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,124 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#define CLIENTS 4
+#define REQUESTS 1000
+
+const int MSG_DOUBLE = 1;
+const int MSG_IGNORE = 2;
+
+int tests_run = 0;
+
+static actor_id_t server;
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void twice(void **stateptr, size_t nbytes, void *data);
+void ignore(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, twice, ignore};
+role_t role = {.nprompts = 3, .prompts = prompts};
+
+void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+}
+
+void twice(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    cacti_request_t *request = data;
+    cacti_reply(request->future, (void *)(2 * (long)request->data));
+}
+
+void ignore(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+}
+
+/* Each client waits for half of its answers and polls for the other half. */
+static void *client(void *data) {
+    long id = (long)data, wrong = 0;
+    for (long i = 0; i < REQUESTS; ++i) {
+        long question = id * REQUESTS + i;
+        cacti_future_t *future;
+        void *answer;
+        if (send_request(server, MSG_DOUBLE, (void *)question, &future) != 0)
+            return (void *)REQUESTS;
+        int result;
+        if (i % 2 == 0)
+            result = cacti_future_wait(future, &answer);
+        else
+            while ((result = cacti_future_poll(future, &answer)) == 1)
+                sched_yield();
+        if (result != 0 || (long)answer != 2 * question)
+            ++wrong;
+        cacti_future_free(future);
+    }
+    return (void *)wrong;
+}
+
+static char *answers()
+{
+    mu_assert("system not created", actor_system_create(&server, &role) == 0);
+    pthread_t clients[CLIENTS];
+    for (long i = 0; i < CLIENTS; ++i)
+        mu_assert("client not created",
+                pthread_create(&clients[i], NULL, client, (void *)i) == 0);
+    long wrong = 0;
+    for (long i = 0; i < CLIENTS; ++i) {
+        void *result;
+        pthread_join(clients[i], &result);
+        wrong += (long)result;
+    }
+
+    // a client may also give up before the reply
+    cacti_future_t *future;
+    mu_assert("request not sent", send_request(server, MSG_DOUBLE, NULL, &future) == 0);
+    cacti_future_free(future);
+
+    send_message(server, (message_t){.message_type = MSG_GODIE});
+    actor_system_join(server);
+    mu_assert("wrong answers", wrong == 0);
+    return 0;
+}
+
+/* The end of the system lets the waiting thread go. */
+static char *no_answer()
+{
+    cacti_future_t *future;
+    void *answer;
+    mu_assert("system not created", actor_system_create(&server, &role) == 0);
+    mu_assert("request not sent", send_request(server, MSG_IGNORE, NULL, &future) == 0);
+    mu_assert("future completed early", cacti_future_poll(future, &answer) == 1);
+    send_message(server, (message_t){.message_type = MSG_GODIE});
+    mu_assert("future not broken", cacti_future_wait(future, &answer) == -1);
+    cacti_future_free(future);
+    actor_system_join(server);
+    mu_assert("request to a finished system sent",
+            send_request(server, MSG_DOUBLE, NULL, &future) == -2);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(answers);
+    mu_run_test(no_answer);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,146 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* More blocks than a ring holds, so that some requests wait for room */
+#define BLOCKS 1000
+#define BLOCK 512
+
+const int MSG_WRITTEN = 1;
+const int MSG_SYNCED = 2;
+const int MSG_READ = 3;
+const int MSG_FAILED = 4;
+
+int tests_run = 0;
+
+static int fd;
+static char written[BLOCKS][BLOCK];
+static char read_back[BLOCKS][BLOCK];
+static long writes, reads, short_transfers, wrong_contexts;
+static long sync_result, failed_result;
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void write_done(void **stateptr, size_t nbytes, void *data);
+void sync_done(void **stateptr, size_t nbytes, void *data);
+void read_done(void **stateptr, size_t nbytes, void *data);
+void failed(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, write_done, sync_done, read_done, failed};
+role_t role = {.nprompts = 5, .prompts = prompts};
+
+static void submit(cacti_io_op_t op, message_type_t reply_type, int file, long block,
+        char *const buf) {
+    cacti_io_request_t request = {.op = op, .fd = file, .buf = buf, .nbytes = BLOCK,
+            .offset = block * BLOCK, .context = (void *)block};
+    cacti_io_submit(actor_id_self(), reply_type, &request);
+}
+
+static void check(size_t nbytes, const cacti_io_result_t *const result, const char *const buf) {
+    if (nbytes != sizeof(cacti_io_result_t) || result->result != BLOCK)
+        ++short_transfers;
+    if (result->buf != buf)
+        ++wrong_contexts;
+}
+
+/* All the blocks are written at once. */
+void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    for (long i = 0; i < BLOCKS; ++i)
+        submit(CACTI_IO_WRITE, MSG_WRITTEN, fd, i, written[i]);
+}
+
+void write_done(__attribute__((unused)) void **stateptr, size_t nbytes, void *data) {
+    cacti_io_result_t *result = data;
+    check(nbytes, result, written[(long)result->context]);
+    if (++writes == BLOCKS)
+        submit(CACTI_IO_FSYNC, MSG_SYNCED, fd, 0, NULL);
+}
+
+void sync_done(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    sync_result = ((cacti_io_result_t *)data)->result;
+    for (long i = 0; i < BLOCKS; ++i)
+        submit(CACTI_IO_READ, MSG_READ, fd, i, read_back[i]);
+}
+
+void read_done(__attribute__((unused)) void **stateptr, size_t nbytes, void *data) {
+    cacti_io_result_t *result = data;
+    check(nbytes, result, read_back[(long)result->context]);
+    if (++reads == BLOCKS)
+        submit(CACTI_IO_READ, MSG_FAILED, -1, 0, read_back[0]);
+}
+
+void failed(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    failed_result = ((cacti_io_result_t *)data)->result;
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+static char *run(bool uring_disabled)
+{
+    char path[] = "/tmp/cacti_test_io_XXXXXX";
+    fd = mkstemp(path);
+    mu_assert("temporary file not created", fd >= 0);
+    unlink(path);
+    for (size_t i = 0; i < BLOCKS; ++i) {
+        for (size_t j = 0; j < BLOCK; ++j)
+            written[i][j] = (char)(i * 7 + j);
+    }
+    memset(read_back, 0, sizeof(read_back));
+    writes = reads = short_transfers = wrong_contexts = 0;
+    sync_result = failed_result = 1;
+
+    actor_id_t leader;
+    actor_system_config_t config = {.pool_size = 2, .io_uring_disabled = uring_disabled};
+    mu_assert("system not created", actor_system_create_ex(&leader, &role, &config) == 0);
+    send_message(leader, (message_t){.message_type = MSG_HELLO});
+    actor_system_join(leader);
+    close(fd);
+
+    mu_assert("requests not completed", writes == BLOCKS && reads == BLOCKS);
+    mu_assert("transfers cut short", short_transfers == 0);
+    mu_assert("results of other requests", wrong_contexts == 0);
+    mu_assert("fsync failed", sync_result == 0);
+    mu_assert("data read differs from data written",
+            memcmp(written, read_back, sizeof(written)) == 0);
+    mu_assert("error not reported", failed_result == -EBADF);
+    return 0;
+}
+
+static char *default_service()
+{
+    return run(false);
+}
+
+static char *thread_pool()
+{
+    return run(true);
+}
+
+static char *all_tests()
+{
+    mu_run_test(default_service);
+    mu_run_test(thread_pool);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
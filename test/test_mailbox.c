@@ -0,0 +1,208 @@
+#include "minunit.h"
+#include "mailbox.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define SENDERS 4
+#define MESSAGES 20000 // per sender
+#define BATCH 3
+#define TURN 16 // messages taken before they are released
+#define RECYCLED_MESSAGES 200000
+#define RECYCLED_LIMIT 64
+#define REMOTE_BATCH 32 // as in msg_pool.c
+
+int tests_run = 0;
+
+static mailbox_t mailbox;
+static _Atomic long scheduled; // pushes which found the mailbox idle
+static _Atomic long mallocs;
+
+/* The test is linked with --wrap=malloc, so that calls of the runtime are counted. */
+void *__real_malloc(size_t size);
+
+void *__wrap_malloc(size_t size) {
+    ++mallocs;
+    return __real_malloc(size);
+}
+
+static long take() {
+    mailbox_node_t *node = mailbox_pop(&mailbox);
+    if (node == NULL)
+        return -1;
+    long data = (long)node->message.data;
+    mailbox_node_free(node);
+    return data;
+}
+
+static message_t numbered(long data) {
+    return (message_t){.message_type = 1, .data = (void *)data};
+}
+
+/* The control lane is drained first, each lane in the order of pushes. */
+static char *lanes()
+{
+    bool was_idle;
+    mailbox_init(&mailbox, 4);
+    mu_assert("first push not accepted",
+            mailbox_push(&mailbox, MAILBOX_NORMAL, numbered(1), NULL, false, &was_idle) == 0);
+    mu_assert("idle mailbox not reported", was_idle);
+    mailbox_push(&mailbox, MAILBOX_NORMAL, numbered(2), NULL, false, &was_idle);
+    mu_assert("busy mailbox reported idle", !was_idle);
+    mailbox_push(&mailbox, MAILBOX_CONTROL, numbered(3), NULL, false, &was_idle);
+    mailbox_push(&mailbox, MAILBOX_CONTROL, numbered(4), NULL, false, &was_idle);
+
+    mu_assert("full mailbox took a message",
+            mailbox_push(&mailbox, MAILBOX_NORMAL, numbered(5), NULL, false, &was_idle) == -1);
+    message_t batch[] = {numbered(5), numbered(6)};
+    mu_assert("full mailbox took a batch",
+            mailbox_push_batch(&mailbox, MAILBOX_NORMAL, batch, 2, false, &was_idle) == -1);
+    mu_assert("overflow not reported",
+            mailbox_push_batch(&mailbox, MAILBOX_NORMAL, batch, 2, true, &was_idle) == 1);
+    mu_assert("wrong size", mailbox_size(&mailbox) == 6 && mailbox_is_full(&mailbox));
+
+    long expected[] = {3, 4, 1, 2, 5, 6};
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i)
+        mu_assert("wrong order of messages", take() == expected[i]);
+    mu_assert("empty mailbox gave a message", take() == -1);
+    mu_assert("messages left after release", mailbox_release(&mailbox, 6) == 0);
+
+    // an inline payload is copied into the node
+    long payload = 42;
+    mailbox_push(&mailbox, MAILBOX_NORMAL, (message_t){.nbytes = sizeof(payload)}, &payload,
+            false, &was_idle);
+    payload = 0;
+    mailbox_node_t *node = mailbox_pop(&mailbox);
+    mu_assert("payload not copied", node != NULL && *(long *)node->message.data == 42);
+    mailbox_node_free(node);
+    mailbox_release(&mailbox, 1);
+    mailbox_destroy(&mailbox);
+    return 0;
+}
+
+/* Sender 0 uses the control lane; the others mix single messages and batches. */
+static void *produce(void *data) {
+    long sender = (long)data;
+    size_t lane = sender == 0 ? MAILBOX_CONTROL : MAILBOX_NORMAL;
+    bool was_idle;
+    for (long i = 0; i < MESSAGES;) {
+        long first = sender * MESSAGES + i;
+        if (sender % 2 == 1 && i + BATCH <= MESSAGES) {
+            message_t batch[BATCH];
+            for (long j = 0; j < BATCH; ++j)
+                batch[j] = numbered(first + j);
+            mailbox_push_batch(&mailbox, lane, batch, BATCH, false, &was_idle);
+            i += BATCH;
+        } else {
+            mailbox_push(&mailbox, lane, numbered(first), NULL, false, &was_idle);
+            ++i;
+        }
+        if (was_idle)
+            ++scheduled;
+    }
+    return NULL;
+}
+
+/* The consumer gets every message, in the order of each sender, while they push. */
+static char *concurrent()
+{
+    mailbox_init(&mailbox, SENDERS * MESSAGES);
+    scheduled = 0;
+    pthread_t senders[SENDERS];
+    for (long i = 0; i < SENDERS; ++i)
+        mu_assert("sender not created",
+                pthread_create(&senders[i], NULL, produce, (void *)i) == 0);
+
+    long next[SENDERS] = {0}, received = 0, idled = 0;
+    int ordered = 1;
+    while (received < SENDERS * MESSAGES) {
+        size_t processed = 0;
+        long data;
+        while (processed < TURN && (data = take()) >= 0) {
+            long sender = data / MESSAGES;
+            ordered = ordered && data % MESSAGES == next[sender];
+            next[sender] = data % MESSAGES + 1;
+            ++processed;
+        }
+        if (processed == 0) {
+            sched_yield();
+            continue;
+        }
+        received += processed;
+        // the next push schedules the owner again
+        if (mailbox_release(&mailbox, processed) == 0)
+            ++idled;
+    }
+    for (long i = 0; i < SENDERS; ++i)
+        pthread_join(senders[i], NULL);
+
+    mu_assert("messages out of order", ordered);
+    mu_assert("message left", take() == -1 && mailbox_size(&mailbox) == 0);
+    mu_assert("owner not scheduled exactly once per idle period", scheduled == idled);
+    mailbox_destroy(&mailbox);
+    return 0;
+}
+
+/* Produces messages one by one, waiting whenever the mailbox is full. */
+static void *produce_only(__attribute__((unused)) void *data) {
+    bool was_idle;
+    for (long i = 0; i < RECYCLED_MESSAGES; ++i) {
+        while (mailbox_push(&mailbox, MAILBOX_NORMAL, numbered(i), NULL, false, &was_idle) != 0)
+            sched_yield();
+    }
+    return NULL;
+}
+
+/* Nodes freed by the consumer go back to the producer, which reuses them. At most
+ * the nodes in the mailbox and those batched by the consumer are ever allocated. */
+static char *recycled()
+{
+    mailbox_init(&mailbox, RECYCLED_LIMIT);
+    pthread_t producer;
+    mallocs = 0;
+    mu_assert("producer not created", pthread_create(&producer, NULL, produce_only, NULL) == 0);
+
+    long next = 0;
+    int ordered = 1;
+    while (next < RECYCLED_MESSAGES) {
+        long data = take();
+        if (data < 0) {
+            sched_yield();
+            continue;
+        }
+        ordered = ordered && data == next++;
+        mailbox_release(&mailbox, 1);
+    }
+    pthread_join(producer, NULL);
+
+    mu_assert("messages out of order", ordered);
+    mu_assert("nodes not reused", mallocs <= RECYCLED_LIMIT + REMOTE_BATCH);
+    mailbox_destroy(&mailbox);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(lanes);
+    mu_run_test(concurrent);
+    mu_run_test(recycled);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,99 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+#define BLOCKS 1000 // many batches returned to the owner at once
+#define SIZE 64
+#define REUSED 256 // blocks kept for reuse by a pool
+
+int tests_run = 0;
+
+static unsigned char *blocks[BLOCKS];
+
+static void *free_blocks(__attribute__((unused)) void *data) {
+    long damaged = 0;
+    for (long i = 0; i < BLOCKS; ++i) {
+        for (size_t j = 0; j < SIZE; ++j)
+            damaged += blocks[i][j] != (unsigned char)(i + j);
+        cacti_msg_free(blocks[i]);
+    }
+    // the last, incomplete batch is returned when the thread ends
+    return (void *)damaged;
+}
+
+static int allocated(const void *const block) {
+    for (long i = 0; i < BLOCKS; ++i) {
+        if (blocks[i] == block)
+            return 1;
+    }
+    return 0;
+}
+
+/* Blocks freed by another thread come back to the pool they were allocated from. */
+static char *remote_free()
+{
+    for (long i = 0; i < BLOCKS; ++i) {
+        blocks[i] = cacti_msg_alloc(SIZE);
+        mu_assert("block not allocated", blocks[i] != NULL);
+        for (size_t j = 0; j < SIZE; ++j)
+            blocks[i][j] = (unsigned char)(i + j);
+    }
+    pthread_t thread;
+    void *damaged;
+    mu_assert("thread not created", pthread_create(&thread, NULL, free_blocks, NULL) == 0);
+    pthread_join(thread, &damaged);
+    mu_assert("block damaged", damaged == NULL);
+
+    void *again[REUSED];
+    int reused = 1;
+    for (long i = 0; i < REUSED; ++i) {
+        again[i] = cacti_msg_alloc(SIZE);
+        reused = reused && allocated(again[i]);
+    }
+    for (long i = 0; i < REUSED; ++i)
+        cacti_msg_free(again[i]);
+    mu_assert("freed blocks not returned", reused);
+    return 0;
+}
+
+/* Payloads too big for the pools and NULL are freed by any thread, too. */
+static void *free_large(void *data) {
+    cacti_msg_free(data);
+    cacti_msg_free(NULL);
+    return NULL;
+}
+
+static char *large()
+{
+    void *block = cacti_msg_alloc(1 << 20);
+    mu_assert("large block not allocated", block != NULL);
+    pthread_t thread;
+    mu_assert("thread not created", pthread_create(&thread, NULL, free_large, block) == 0);
+    pthread_join(thread, NULL);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(remote_free);
+    mu_run_test(large);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
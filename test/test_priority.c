@@ -0,0 +1,136 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdio.h>
+
+/* A single worker makes the order of handlers deterministic. */
+
+#define BULK 100
+#define PEERS 8
+
+const int MSG_BULK = 1;
+const int MSG_MARK = 2;
+const int MSG_READY = 3;
+const int MSG_RUN = 4;
+
+int tests_run = 0;
+
+static long bulk_seen, bulk_before_mark;
+static actor_id_t peers[PEERS + 1];
+static actor_id_t high_peer;
+static size_t npeers;
+static actor_id_t run_order[PEERS + 1];
+static size_t nrun;
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void high_hello(void **stateptr, size_t nbytes, void *data);
+void bulk(void **stateptr, size_t nbytes, void *data);
+void mark(void **stateptr, size_t nbytes, void *data);
+void ready(void **stateptr, size_t nbytes, void *data);
+void run(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, bulk, mark, ready, run};
+role_t role = {.nprompts = 5, .prompts = prompts};
+act_t high_prompts[] = {high_hello, bulk, mark, ready, run};
+role_t high_role = {.nprompts = 5, .prompts = high_prompts, .priority = CACTI_PRIORITY_HIGH};
+
+/* The leader floods itself and then asks urgently for the mark and to die. */
+void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    actor_id_t parent = (actor_id_t)data;
+    if (parent == -1) {
+        for (int i = 0; i < BULK; ++i)
+            send_message(actor_id_self(), (message_t){.message_type = MSG_BULK});
+        send_message_urgent(actor_id_self(), (message_t){.message_type = MSG_MARK});
+        send_message_urgent(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+        return;
+    }
+    send_message(parent, (message_t){.message_type = MSG_READY,
+            .data = (void *)actor_id_self()});
+}
+
+void high_hello(void **stateptr, size_t nbytes, void *data) {
+    high_peer = actor_id_self();
+    hello(stateptr, nbytes, data);
+}
+
+void bulk(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    ++bulk_seen;
+}
+
+void mark(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    bulk_before_mark = bulk_seen;
+}
+
+/* The leader makes all the peers runnable at once, the high priority one last. */
+void ready(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    peers[npeers++] = (actor_id_t)data;
+    if (npeers < PEERS + 1)
+        return;
+    for (size_t i = 0; i <= PEERS; ++i) {
+        if (peers[i] != high_peer)
+            send_message(peers[i], (message_t){.message_type = MSG_RUN});
+    }
+    send_message(high_peer, (message_t){.message_type = MSG_RUN});
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+void run(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    run_order[nrun++] = actor_id_self();
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+static char *control_lane_first()
+{
+    actor_id_t leader;
+    actor_system_config_t config = {.pool_size = 1};
+
+    mu_assert("system not created", actor_system_create_ex(&leader, &role, &config) == 0);
+    send_message(leader, (message_t){.message_type = MSG_HELLO, .data = (void *)-1});
+    actor_system_join(leader);
+    mu_assert("urgent message waited behind bulk ones", bulk_before_mark == 0);
+    mu_assert("messages left behind by MSG_GODIE were not handled", bulk_seen == BULK);
+    return 0;
+}
+
+static char *high_priority_first()
+{
+    actor_id_t leader;
+    actor_system_config_t config = {.pool_size = 1};
+
+    mu_assert("system not created", actor_system_create_ex(&leader, &role, &config) == 0);
+    for (int i = 0; i < PEERS; ++i)
+        send_message(leader, (message_t){.message_type = MSG_SPAWN, .data = &role});
+    send_message(leader, (message_t){.message_type = MSG_SPAWN, .data = &high_role});
+    actor_system_join(leader);
+    mu_assert("not all peers ran", nrun == PEERS + 1);
+    mu_assert("high priority actor ran after normal ones", run_order[0] == high_peer);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(control_lane_first);
+    mu_run_test(high_priority_first);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,154 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define RECEIVERS 100
+#define PAYLOAD (1 << 20)
+
+const int MSG_REPORT = 1;
+const int MSG_DATA = 2;
+const int MSG_LATER = 3;
+
+int tests_run = 0;
+
+static actor_id_t receivers[RECEIVERS];
+static size_t reported;
+static unsigned char *sent;
+static _Atomic long received, same_buffer, intact, kept_intact; // by receivers on any worker
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void report(void **stateptr, size_t nbytes, void *data);
+void take(void **stateptr, size_t nbytes, void *data);
+void later(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, report, take, later};
+role_t role = {.nprompts = 4, .prompts = prompts};
+
+static void godie() {
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+static bool filled(const unsigned char *const data) {
+    for (size_t i = 0; i < PAYLOAD; i += 4096) {
+        if (data[i] != (unsigned char)(i / 4096))
+            return false;
+    }
+    return true;
+}
+
+/* The leader spawns the receivers, which report to it. */
+void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    actor_id_t parent = (actor_id_t)data;
+    if (parent == -1) {
+        for (int i = 0; i < RECEIVERS; ++i)
+            send_message(actor_id_self(), (message_t){.message_type = MSG_SPAWN, .data = &role});
+        return;
+    }
+    send_message(parent, (message_t){.message_type = MSG_REPORT, .data = (void *)actor_id_self()});
+}
+
+/* Once all the receivers are there, the leader broadcasts the payload and forgets it. */
+void report(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    receivers[reported++] = (actor_id_t)data;
+    if (reported < RECEIVERS)
+        return;
+    unsigned char *payload = cacti_shared_alloc(PAYLOAD);
+    for (size_t i = 0; i < PAYLOAD; i += 4096)
+        payload[i] = (unsigned char)(i / 4096);
+    sent = payload;
+    send_shared(receivers, RECEIVERS, MSG_DATA, payload);
+    cacti_shared_release(payload);
+    godie();
+}
+
+/* The first receiver keeps the payload for a later message. */
+void take(void **stateptr, size_t nbytes, void *data) {
+    ++received;
+    if (data == sent && nbytes == PAYLOAD)
+        ++same_buffer;
+    if (filled(data))
+        ++intact;
+    if (actor_id_self() == receivers[0]) {
+        cacti_shared_retain(data);
+        *stateptr = data;
+        send_message(actor_id_self(), (message_t){.message_type = MSG_LATER});
+        return;
+    }
+    godie();
+}
+
+void later(void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    if (filled(*stateptr))
+        ++kept_intact;
+    cacti_shared_release(*stateptr);
+    godie();
+}
+
+static char *broadcast()
+{
+    actor_id_t leader;
+    reported = 0;
+    received = same_buffer = intact = kept_intact = 0;
+    mu_assert("system not created", actor_system_create(&leader, &role) == 0);
+    send_message(leader, (message_t){.message_type = MSG_HELLO, .data = (void *)-1L});
+    actor_system_join(leader);
+    mu_assert("payload lost", received == RECEIVERS);
+    mu_assert("payload copied", same_buffer == RECEIVERS);
+    mu_assert("payload changed", intact == RECEIVERS);
+    mu_assert("kept payload changed", kept_intact == 1);
+    return 0;
+}
+
+/* A thread outside of the system may give up its reference at once, and targets
+ * which do not take the message do not keep the payload. */
+static char *from_outside()
+{
+    actor_id_t leader;
+    reported = 0;
+    received = same_buffer = intact = kept_intact = 0;
+    mu_assert("system not created", actor_system_create(&leader, &role) == 0);
+    receivers[0] = -1; // none of them keeps the payload
+
+    unsigned char *payload = cacti_shared_alloc(PAYLOAD);
+    mu_assert("payload not allocated", payload != NULL);
+    for (size_t i = 0; i < PAYLOAD; i += 4096)
+        payload[i] = (unsigned char)(i / 4096);
+    sent = payload;
+    actor_id_t targets[] = {leader, leader + CAST_LIMIT / 2};
+    mu_assert("missing target not reported", send_shared(targets, 2, MSG_DATA, payload) == -2);
+    cacti_shared_release(payload);
+    actor_system_join(leader);
+
+    mu_assert("payload lost", received == 1);
+    mu_assert("payload copied", same_buffer == 1);
+    mu_assert("payload changed", intact == 1);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(broadcast);
+    mu_run_test(from_outside);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,138 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <time.h>
+
+#define CYCLES 200
+#define CHILDREN 50
+
+const int MSG_COUNT = 1;
+
+int tests_run = 0;
+
+static long counted;
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void count(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, count};
+role_t role = {.nprompts = 2, .prompts = prompts};
+
+/* The leader spawns the children, each of them reports to it and dies. */
+void hello(void **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    actor_id_t parent = (actor_id_t)data;
+    if (parent == -1) {
+        *stateptr = (void *)0L;
+        for (int i = 0; i < CHILDREN; ++i)
+            send_message(actor_id_self(), (message_t){.message_type = MSG_SPAWN, .data = &role});
+        return;
+    }
+    send_message(parent, (message_t){.message_type = MSG_COUNT});
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+void count(void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    long n = (long)*stateptr + 1;
+    *stateptr = (void *)n;
+    ++counted;
+    if (n == CHILDREN)
+        send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+static size_t threads() {
+    size_t n = 0;
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == NULL)
+        return 0;
+    while (readdir(dir) != NULL)
+        ++n;
+    closedir(dir);
+    return n - 2; // . and ..
+}
+
+static int run(size_t pool_size, actor_id_t *const leader) {
+    actor_system_config_t config = {.pool_size = pool_size};
+    if (actor_system_create_ex(leader, &role, &config) != 0)
+        return -1;
+    send_message(*leader, (message_t){.message_type = MSG_HELLO, .data = (void *)-1L});
+    actor_system_join(*leader);
+    return 0;
+}
+
+/* Systems of two shapes take turns, each starting with the threads of the previous
+ * one of its shape. */
+static char *threads_reused()
+{
+    actor_id_t first, leader;
+    counted = 0;
+    mu_assert("system not created", run(2, &first) == 0);
+    mu_assert("system not created", run(3, &leader) == 0);
+    size_t before = threads();
+    for (int i = 0; i < CYCLES; ++i) {
+        mu_assert("system not created", run(2 + i % 2, &leader) == 0);
+        mu_assert("actor ids not reused", leader == first);
+    }
+    mu_assert("messages lost", counted == (CYCLES + 2) * CHILDREN);
+    mu_assert("threads not reused", threads() == before);
+    return 0;
+}
+
+static char *handles_reused()
+{
+    actor_system_t *system;
+    actor_id_t leader;
+    counted = 0;
+    size_t before = threads();
+    for (int i = 0; i < CYCLES; ++i) {
+        actor_system_config_t config = {.pool_size = 2};
+        mu_assert("system not created",
+                actor_system_new(&system, &leader, &role, &config) == 0);
+        send_message(leader, (message_t){.message_type = MSG_HELLO, .data = (void *)-1L});
+        actor_system_wait(system);
+    }
+    mu_assert("messages lost", counted == CYCLES * CHILDREN);
+    mu_assert("threads not reused", threads() == before);
+    return 0;
+}
+
+static char *spares_released()
+{
+    // the spare systems have 2 and 3 threads, which end on their own
+    size_t before = threads();
+    actor_system_release_spares();
+    for (int i = 0; i < 1000 && threads() > before - 5; ++i)
+        nanosleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+    mu_assert("threads not ended", threads() == before - 5);
+    actor_id_t leader;
+    counted = 0;
+    mu_assert("system not created", run(2, &leader) == 0);
+    mu_assert("messages lost", counted == CHILDREN);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(threads_reused);
+    mu_run_test(handles_reused);
+    mu_run_test(spares_released);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,155 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define CHILDREN 10
+#define PINGS 100
+#define TRIES 5000
+
+const int MSG_PING = 1;
+const int MSG_REPORT = 2;
+
+int tests_run = 0;
+
+static actor_id_t leader, children[CHILDREN];
+static size_t reported; // by the leader
+static atomic_bool done;
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void ping(void **stateptr, size_t nbytes, void *data);
+void report(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, ping, report};
+role_t role = {.nprompts = 3, .prompts = prompts};
+
+/* The leader spawns the children, each of which pings itself and reports
+ * to the leader once it has got all its pings. */
+void hello(void **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    actor_id_t parent = (actor_id_t)data;
+    if (parent == -1) {
+        for (int i = 0; i < CHILDREN; ++i)
+            send_message(actor_id_self(), (message_t){.message_type = MSG_SPAWN, .data = &role});
+        return;
+    }
+    *stateptr = (void *)parent;
+    for (int i = 0; i < PINGS; ++i)
+        send_message(actor_id_self(), (message_t){.message_type = MSG_PING,
+                .data = (void *)(long)i});
+}
+
+void ping(void **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    if ((long)data == PINGS - 1)
+        send_message((actor_id_t)*stateptr, (message_t){.message_type = MSG_REPORT,
+                .data = (void *)actor_id_self()});
+}
+
+void report(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    children[reported++] = (actor_id_t)data;
+    if (reported == CHILDREN)
+        atomic_store(&done, true);
+}
+
+static unsigned long processed(const cacti_stats_t *const stats) {
+    unsigned long sum = 0;
+    for (size_t i = 0; i < stats->nworkers; ++i)
+        sum += stats->workers[i].messages_processed;
+    return sum;
+}
+
+/* Counters of a turn are added once it ends, so a snapshot may lag behind
+ * the handlers for a moment. */
+static cacti_stats_t *settled_snapshot(unsigned long expected) {
+    cacti_stats_t *stats = cacti_stats_snapshot();
+    for (int i = 0; i < TRIES && stats != NULL && processed(stats) < expected; ++i) {
+        free(stats);
+        usleep(1000);
+        stats = cacti_stats_snapshot();
+    }
+    return stats;
+}
+
+static int settled_actor(actor_id_t actor, unsigned long expected, cacti_actor_stats_t *out) {
+    int result = cacti_stats_actor(actor, out);
+    for (int i = 0; i < TRIES && result == 0 && out->messages_processed < expected; ++i) {
+        usleep(1000);
+        result = cacti_stats_actor(actor, out);
+    }
+    return result;
+}
+
+static char *counters()
+{
+    reported = 0;
+    atomic_store(&done, false);
+    mu_assert("system not created", actor_system_create(&leader, &role) == 0);
+    send_message(leader, (message_t){.message_type = MSG_HELLO, .data = (void *)-1L});
+    while (!atomic_load(&done))
+        usleep(1000);
+
+    // The leader handles its hello, the spawns and the reports, each child its hello
+    // and the pings. The runtime sends the children their hellos.
+    unsigned long expected = 1 + 2 * CHILDREN + CHILDREN * (1 + PINGS);
+    cacti_stats_t *stats = settled_snapshot(expected);
+    mu_assert("no snapshot", stats != NULL);
+    unsigned long sent = 0, spawned = 0;
+    for (size_t i = 0; i < stats->nworkers; ++i) {
+        sent += stats->workers[i].messages_sent;
+        spawned += stats->workers[i].spawned;
+    }
+    unsigned long total = processed(stats);
+    size_t alive = stats->alive_actors, outside = stats->messages_sent_outside;
+    long median = cacti_stats_latency_percentile(stats, 50);
+    free(stats);
+    mu_assert("wrong number of messages processed", total == expected);
+    mu_assert("wrong number of messages sent", sent == expected - 1);
+    mu_assert("wrong number of messages sent from outside", outside == 1);
+    mu_assert("wrong number of actors spawned", spawned == 1 + CHILDREN); // with the leader
+    mu_assert("wrong number of actors alive", alive == 1 + CHILDREN);
+    mu_assert("latency not recorded", median >= 0);
+
+    cacti_actor_stats_t actor;
+    mu_assert("no stats of the leader", settled_actor(leader, 1 + 2 * CHILDREN, &actor) == 0);
+    mu_assert("wrong number of messages of the leader",
+            actor.messages_processed == 1 + 2 * CHILDREN && actor.mailbox_size == 0);
+    for (int i = 0; i < CHILDREN; ++i) {
+        mu_assert("no stats of a child", settled_actor(children[i], 1 + PINGS, &actor) == 0);
+        mu_assert("wrong number of messages of a child",
+                actor.messages_processed == 1 + PINGS && actor.mailbox_size == 0);
+        mu_assert("pings not seen waiting", actor.mailbox_high_water >= PINGS);
+    }
+    mu_assert("missing actor found", cacti_stats_actor(leader + CAST_LIMIT / 2, &actor) == -2);
+
+    for (int i = 0; i < CHILDREN; ++i)
+        send_message(children[i], (message_t){.message_type = MSG_GODIE});
+    send_message(leader, (message_t){.message_type = MSG_GODIE});
+    actor_system_join(leader);
+    mu_assert("snapshot of an ended system", cacti_stats_snapshot() == NULL);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(counters);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
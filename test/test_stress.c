@@ -0,0 +1,212 @@
+#include "minunit.h"
+#include "cacti.h"
+#include "clock.h"
+#include "err.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Randomized stress test: actors spawn each other, send bursts of messages
+ * to random peers and die at random moments. Every message carries a sequence
+ * number of its sender-receiver pair, so that losses, duplicates and reordering
+ * are detected. The system is created and joined repeatedly, with growing
+ * worker counts, and the throughput of each count is reported. */
+
+#define MAX_ACTORS 128
+#define INITIAL_ACTORS 32
+#define SENDS_PER_ACTOR 1000
+#define BURST 16
+#define CYCLES 5
+
+const int MSG_TICK = 1;
+const int MSG_ITEM = 2;
+
+typedef struct {
+    actor_id_t sender;
+    long seq;
+} item_t;
+
+typedef struct {
+    long next_sent[MAX_ACTORS]; // sequence number of the next message to each actor
+    long next_received[MAX_ACTORS]; // sequence number expected from each actor
+    long remaining;
+    unsigned rand_state;
+} stress_state_t;
+
+static stress_state_t *states[MAX_ACTORS];
+static _Atomic actor_id_t max_id;
+static _Atomic long sent, received, disorders, spawns;
+
+int tests_run = 0;
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void tick(void **stateptr, size_t nbytes, void *data);
+void item(void **stateptr, size_t nbytes, item_t *data);
+
+act_t prompts[] = {hello, tick, (act_t)item};
+role_t role = {.nprompts = 3, .prompts = prompts};
+
+static stress_state_t *state_of(void **stateptr) {
+    if (*stateptr != NULL)
+        return *stateptr;
+
+    actor_id_t self = actor_id_self();
+    stress_state_t *state = calloc(1, sizeof(stress_state_t));
+    if (state == NULL)
+        fatal("calloc failed");
+    state->remaining = SENDS_PER_ACTOR;
+    state->rand_state = (unsigned)self * 2654435761u + 1;
+    states[self] = state;
+
+    actor_id_t known = atomic_load(&max_id);
+    while (known < self && !atomic_compare_exchange_weak(&max_id, &known, self));
+    return *stateptr = state;
+}
+
+void hello(void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    state_of(stateptr);
+    send_message(actor_id_self(), (message_t){.message_type = MSG_TICK});
+}
+
+void tick(void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    stress_state_t *state = state_of(stateptr);
+    actor_id_t self = actor_id_self();
+
+    for (int i = 0; i < BURST && state->remaining > 0; ++i, --state->remaining) {
+        actor_id_t target = rand_r(&state->rand_state) % (atomic_load(&max_id) + 1);
+        item_t msg = {.sender = self, .seq = state->next_sent[target]};
+        // a dead target rejects the message, which is not counted then
+        if (send_message_inline(target, MSG_ITEM, &msg, sizeof(msg)) == 0) {
+            ++state->next_sent[target];
+            atomic_fetch_add_explicit(&sent, 1, memory_order_relaxed);
+        }
+    }
+
+    if (rand_r(&state->rand_state) % 64 == 0 &&
+            atomic_fetch_add(&spawns, 1) < MAX_ACTORS - INITIAL_ACTORS)
+        send_message(self, (message_t){.message_type = MSG_SPAWN, .data = &role});
+    if (rand_r(&state->rand_state) % 256 == 0)
+        state->remaining = 0; // dies early
+
+    if (state->remaining > 0)
+        send_message(self, (message_t){.message_type = MSG_TICK});
+    else
+        send_message(self, (message_t){.message_type = MSG_GODIE});
+}
+
+void item(void **stateptr, __attribute__((unused)) size_t nbytes, item_t *data) {
+    stress_state_t *state = state_of(stateptr);
+    if (data->seq != state->next_received[data->sender])
+        atomic_fetch_add(&disorders, 1);
+    state->next_received[data->sender] = data->seq + 1;
+    atomic_fetch_add_explicit(&received, 1, memory_order_relaxed);
+}
+
+static long resident_kb() {
+    long pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+        if (fscanf(statm, "%*s %ld", &pages) != 1)
+            pages = 0;
+        fclose(statm);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Runs one create-join cycle. Returns the number of messages delivered or -1. */
+static long run_cycle(size_t workers, size_t numa_nodes) {
+    actor_id_t leader;
+    atomic_store(&max_id, 0);
+    atomic_store(&sent, 0);
+    atomic_store(&received, 0);
+    atomic_store(&disorders, 0);
+    atomic_store(&spawns, 0);
+
+    if (actor_system_create_ex(&leader, &role,
+            &(actor_system_config_t){.pool_size = workers, .numa_nodes = numa_nodes}) != 0)
+        return -1;
+    for (int i = 1; i < INITIAL_ACTORS; ++i)
+        send_message(leader, (message_t){.message_type = MSG_SPAWN, .data = &role});
+    send_message(leader, (message_t){.message_type = MSG_TICK});
+    actor_system_join(leader);
+
+    for (int i = 0; i < MAX_ACTORS; ++i) {
+        free(states[i]);
+        states[i] = NULL;
+    }
+    if (atomic_load(&sent) != atomic_load(&received) || atomic_load(&disorders) != 0) {
+        printf(__FILE__ ": %zu workers: sent %ld, received %ld, out of order %ld\n", workers,
+                atomic_load(&sent), atomic_load(&received), atomic_load(&disorders));
+        return -1;
+    }
+    return atomic_load(&received);
+}
+
+static char *conservation_and_ordering()
+{
+    const size_t worker_counts[] = {1, 2, 4, 8};
+
+    for (size_t i = 0; i < sizeof(worker_counts) / sizeof(size_t); ++i) {
+        long messages = 0;
+        long baseline_kb = 0;
+        long start = monotonic_nanos();
+        for (int cycle = 0; cycle < CYCLES; ++cycle) {
+            long delivered = run_cycle(worker_counts[i], 0);
+            mu_assert("messages lost, duplicated or reordered", delivered >= 0);
+            messages += delivered;
+            if (cycle == 0)
+                baseline_kb = resident_kb();
+        }
+        double seconds = (double)(monotonic_nanos() - start) / 1e9;
+        printf(__FILE__ ": %zu workers: %ld messages, %.0f msgs/s, %ld kB -> %ld kB\n",
+                worker_counts[i], messages, (double)messages / seconds, baseline_kb,
+                resident_kb());
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+        // Finished systems have to give their memory back; sanitizers hold on to it.
+        mu_assert("memory grows across create/join cycles",
+                resident_kb() <= baseline_kb + baseline_kb / 4 + 4096);
+#endif
+    }
+    return 0;
+}
+
+/* Actors of other nodes are scheduled through their nodes' queues. */
+static char *simulated_numa_nodes()
+{
+    const size_t configs[][2] = {{2, 2}, {6, 3}, {8, 4}, {3, 8}};
+
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); ++i) {
+        for (int cycle = 0; cycle < CYCLES; ++cycle)
+            mu_assert("messages lost, duplicated or reordered across nodes",
+                    run_cycle(configs[i][0], configs[i][1]) >= 0);
+    }
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(conservation_and_ordering);
+    mu_run_test(simulated_numa_nodes);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,123 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define SYSTEMS 4
+#define HOPS 10000
+
+const int MSG_PING = 1;
+const int MSG_PONG = 2;
+
+int tests_run = 0;
+
+static _Atomic long hops[SYSTEMS + 1];
+static _Atomic long pongs;
+
+/* The leader spawns a partner and both pass a counter back and forth. The data
+ * of MSG_HELLO is the parent, the counter carries the index of the system. */
+void hello(void **stateptr, size_t nbytes, void *data);
+void ping(void **stateptr, size_t nbytes, long *data);
+void pong(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, (act_t)ping, pong};
+role_t role = {.nprompts = 3, .prompts = prompts};
+
+void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    actor_id_t parent = (actor_id_t)data;
+    long counter[2] = {parent >> CACTI_SYSTEM_SHIFT, 0};
+    send_message_inline(parent, MSG_PING, counter, sizeof(counter));
+}
+
+void ping(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        long *data) {
+    long counter[2] = {data[0], data[1] + 1};
+    atomic_fetch_add(&hops[counter[0]], 1);
+    if (counter[1] < HOPS) {
+        // the partner is the other one of the first two actors of the system
+        actor_id_t self = actor_id_self();
+        send_message_inline(self ^ 1, MSG_PING, counter, sizeof(counter));
+    } else {
+        send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+        send_message(actor_id_self() ^ 1, (message_t){.message_type = MSG_GODIE});
+    }
+}
+
+/* Counts a message from another system and answers it back, if the sender is given */
+void pong(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    atomic_fetch_add(&pongs, 1);
+    if (data != NULL)
+        send_message((actor_id_t)data, (message_t){.message_type = MSG_PONG});
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+static char *independent_systems()
+{
+    actor_system_t *systems[SYSTEMS];
+    actor_id_t leaders[SYSTEMS + 1];
+
+    mu_assert("default system not created", actor_system_create(&leaders[SYSTEMS], &role) == 0);
+    mu_assert("second default system created", actor_system_create(&leaders[0], &role) != 0);
+    for (size_t i = 0; i < SYSTEMS; ++i) {
+        mu_assert("system not created", actor_system_new(&systems[i], &leaders[i], &role,
+                &(actor_system_config_t){.pool_size = i + 1}) == 0);
+    }
+    for (size_t i = 0; i <= SYSTEMS; ++i) {
+        for (size_t j = 0; j < i; ++j)
+            mu_assert("systems share a slot", leaders[i] >> CACTI_SYSTEM_SHIFT !=
+                    leaders[j] >> CACTI_SYSTEM_SHIFT);
+        atomic_store(&hops[leaders[i] >> CACTI_SYSTEM_SHIFT], 0);
+        send_message(leaders[i], (message_t){.message_type = MSG_SPAWN, .data = &role});
+    }
+
+    actor_system_join(leaders[SYSTEMS]);
+    for (size_t i = 0; i < SYSTEMS; ++i)
+        actor_system_wait(systems[i]);
+    for (size_t i = 0; i <= SYSTEMS; ++i)
+        mu_assert("hops lost", atomic_load(&hops[leaders[i] >> CACTI_SYSTEM_SHIFT]) == HOPS);
+    mu_assert("message sent to a finished system",
+            send_message(leaders[0], (message_t){.message_type = MSG_GODIE}) == -2);
+    return 0;
+}
+
+static char *messages_across_systems()
+{
+    actor_system_t *first, *second;
+    actor_id_t a, b;
+
+    atomic_store(&pongs, 0);
+    mu_assert("system not created", actor_system_new(&first, &a, &role, NULL) == 0);
+    mu_assert("system not created", actor_system_new(&second, &b, &role, NULL) == 0);
+    send_message(b, (message_t){.message_type = MSG_PONG, .data = (void *)a});
+    actor_system_wait(first);
+    actor_system_wait(second);
+    mu_assert("message across systems lost", atomic_load(&pongs) == 2);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(independent_systems);
+    mu_run_test(messages_across_systems);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
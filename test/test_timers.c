@@ -0,0 +1,191 @@
+#include "minunit.h"
+#include "cacti.h"
+#include "clock.h"
+
+#include <stdio.h>
+
+#define MILLIS 1000000L
+#define DELAYED 3
+#define TICKS 5
+#define MANY 100000
+#define SLEEPERS 8
+
+const int MSG_ARM = 1;
+const int MSG_RING = 2;
+
+int tests_run = 0;
+
+typedef enum { DELAYED_ORDER, PERIODIC, CANCELLED, MANY_TIMERS, SLEEPING } scenario_t;
+
+static scenario_t scenario;
+static long started;
+static long rings, early_rings;
+static long ring_order[DELAYED];
+static cacti_timer_t periodic;
+static int first_cancel, second_cancel;
+static actor_id_t leader;
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void arm(void **stateptr, size_t nbytes, void *data);
+void ring(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, arm, ring};
+role_t role = {.nprompts = 3, .prompts = prompts};
+
+static void godie() {
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+/* A sleeper waits for its own timer, so that it does not keep a worker. */
+void hello(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    send_message_after(actor_id_self(), (message_t){.message_type = MSG_RING}, 50 * MILLIS);
+}
+
+void arm(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    started = monotonic_nanos();
+    switch (scenario) {
+        case DELAYED_ORDER:
+            for (long i = DELAYED; i > 0; --i)
+                send_message_after(actor_id_self(),
+                        (message_t){.message_type = MSG_RING, .data = (void *)i}, i * 10 * MILLIS);
+            break;
+        case PERIODIC:
+            cacti_timer_start(&periodic, actor_id_self(), (message_t){.message_type = MSG_RING},
+                    MILLIS, 2 * MILLIS);
+            break;
+        case CANCELLED: {
+            cacti_timer_t timer;
+            cacti_timer_start(&timer, actor_id_self(), (message_t){.message_type = MSG_RING},
+                    10 * MILLIS, 0);
+            first_cancel = cacti_timer_cancel(timer);
+            second_cancel = cacti_timer_cancel(timer);
+            send_message_after(actor_id_self(), (message_t){.message_type = MSG_GODIE},
+                    20 * MILLIS);
+        }
+            break;
+        case MANY_TIMERS:
+            for (long i = 0; i < MANY; ++i)
+                send_message_after(actor_id_self(), (message_t){.message_type = MSG_RING},
+                        i % 97 * MILLIS / 2);
+            break;
+        case SLEEPING:
+            for (int i = 0; i < SLEEPERS; ++i)
+                send_message(actor_id_self(),
+                        (message_t){.message_type = MSG_SPAWN, .data = &role});
+            godie();
+            break;
+    }
+}
+
+void ring(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        void *data) {
+    long elapsed = monotonic_nanos() - started;
+    switch (scenario) {
+        case DELAYED_ORDER:
+            if (elapsed < (long)data * 10 * MILLIS)
+                ++early_rings;
+            ring_order[rings++] = (long)data;
+            if (rings == DELAYED)
+                godie();
+            break;
+        case PERIODIC:
+            if (elapsed < MILLIS + rings * 2 * MILLIS)
+                ++early_rings;
+            if (++rings == TICKS) {
+                cacti_timer_cancel(periodic);
+                // more rings would come before this one if the timer were still running,
+                // but one of them may be on its way already
+                send_message_after(actor_id_self(), (message_t){.message_type = MSG_GODIE},
+                        10 * MILLIS);
+            }
+            break;
+        case MANY_TIMERS:
+            if (++rings == MANY)
+                godie();
+            break;
+        default:
+            ++rings;
+            godie();
+    }
+}
+
+static void run(scenario_t s, size_t workers) {
+    scenario = s;
+    rings = 0;
+    early_rings = 0;
+    actor_system_create_ex(&leader, &role, &(actor_system_config_t){.pool_size = workers});
+    send_message(leader, (message_t){.message_type = MSG_ARM});
+    actor_system_join(leader);
+}
+
+static char *delayed_messages()
+{
+    run(DELAYED_ORDER, 2);
+    mu_assert("delayed messages lost", rings == DELAYED);
+    mu_assert("delayed message came early", early_rings == 0);
+    for (long i = 0; i < DELAYED; ++i)
+        mu_assert("delayed messages out of order", ring_order[i] == i + 1);
+    return 0;
+}
+
+static char *periodic_timer()
+{
+    run(PERIODIC, 2);
+    mu_assert("periodic timer not stopped", rings == TICKS || rings == TICKS + 1);
+    mu_assert("periodic message came early", early_rings == 0);
+    return 0;
+}
+
+static char *cancelled_timer()
+{
+    run(CANCELLED, 2);
+    mu_assert("pending timer not cancelled", first_cancel == 0);
+    mu_assert("timer cancelled twice", second_cancel == -1);
+    mu_assert("cancelled timer fired", rings == 0);
+    return 0;
+}
+
+static char *many_timers()
+{
+    run(MANY_TIMERS, 2);
+    mu_assert("messages of timers lost", rings == MANY);
+    return 0;
+}
+
+/* Actors waiting for timers do not keep the only worker busy. */
+static char *waiting_without_worker()
+{
+    run(SLEEPING, 1);
+    long elapsed = monotonic_nanos() - started;
+    mu_assert("sleepers lost", rings == SLEEPERS);
+    mu_assert("sleepers waited one after another", elapsed < SLEEPERS * 50 * MILLIS / 2);
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(delayed_messages);
+    mu_run_test(periodic_timer);
+    mu_run_test(cancelled_timer);
+    mu_run_test(many_timers);
+    mu_run_test(waiting_without_worker);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
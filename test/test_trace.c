@@ -0,0 +1,205 @@
+#include "minunit.h"
+#include "cacti.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHILDREN 10
+#define PINGS 100
+#define MAX_THREADS 64
+#define TRACE_PATH "test_trace.json"
+
+const int MSG_PING = 1;
+const int MSG_REPORT = 2;
+
+int tests_run = 0;
+
+static size_t reported; // by the leader
+
+void hello(void **stateptr, size_t nbytes, void *data);
+void ping(void **stateptr, size_t nbytes, void *data);
+void report(void **stateptr, size_t nbytes, void *data);
+
+act_t prompts[] = {hello, ping, report};
+role_t role = {.nprompts = 3, .prompts = prompts};
+
+static void godie() {
+    send_message(actor_id_self(), (message_t){.message_type = MSG_GODIE});
+}
+
+/* The leader spawns the children, each of which pings itself, reports to the leader
+ * and dies. The leader dies once all of them have reported. */
+void hello(void **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    actor_id_t parent = (actor_id_t)data;
+    if (parent == -1) {
+        for (int i = 0; i < CHILDREN; ++i)
+            send_message(actor_id_self(), (message_t){.message_type = MSG_SPAWN, .data = &role});
+        return;
+    }
+    *stateptr = (void *)parent;
+    for (int i = 0; i < PINGS; ++i)
+        send_message(actor_id_self(), (message_t){.message_type = MSG_PING,
+                .data = (void *)(long)i});
+}
+
+void ping(void **stateptr, __attribute__((unused)) size_t nbytes, void *data) {
+    if ((long)data < PINGS - 1)
+        return;
+    send_message((actor_id_t)*stateptr, (message_t){.message_type = MSG_REPORT});
+    godie();
+}
+
+void report(__attribute__((unused)) void **stateptr, __attribute__((unused)) size_t nbytes,
+        __attribute__((unused)) void *data) {
+    if (++reported == CHILDREN)
+        godie();
+}
+
+/* A minimal JSON checker: returns the end of the value at p, or NULL if there is none. */
+static const char *json_value(const char *p);
+
+static const char *json_space(const char *p) {
+    while (isspace((unsigned char)*p))
+        ++p;
+    return p;
+}
+
+static const char *json_string(const char *p) {
+    if (*p++ != '"')
+        return NULL;
+    for (; *p != '"'; ++p) {
+        if (*p == '\0' || (*p == '\\' && *++p == '\0'))
+            return NULL;
+    }
+    return p + 1;
+}
+
+/* Parses the members of an object (pairs) or an array, up to the closing bracket. */
+static const char *json_members(const char *p, char close, int pairs) {
+    p = json_space(p + 1);
+    if (*p == close)
+        return p + 1;
+    while (p != NULL) {
+        if (pairs) {
+            if ((p = json_string(p)) == NULL || *(p = json_space(p)) != ':')
+                return NULL;
+            p = json_space(p + 1);
+        }
+        if ((p = json_value(p)) == NULL)
+            return NULL;
+        p = json_space(p);
+        if (*p == close)
+            return p + 1;
+        p = *p == ',' ? json_space(p + 1) : NULL;
+    }
+    return NULL;
+}
+
+static const char *json_value(const char *p) {
+    char *end;
+    switch (*p) {
+        case '{':
+            return json_members(p, '}', 1);
+        case '[':
+            return json_members(p, ']', 0);
+        case '"':
+            return json_string(p);
+        case 't':
+            return strncmp(p, "true", 4) == 0 ? p + 4 : NULL;
+        case 'f':
+            return strncmp(p, "false", 5) == 0 ? p + 5 : NULL;
+        case 'n':
+            return strncmp(p, "null", 4) == 0 ? p + 4 : NULL;
+        default:
+            strtod(p, &end);
+            return end != p ? end : NULL;
+    }
+}
+
+static char *read_file(const char *const path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    char *text = size >= 0 ? malloc(size + 1) : NULL;
+    if (text != NULL)
+        text[fread(text, 1, size, file)] = '\0';
+    fclose(file);
+    return text;
+}
+
+/* The trace of the system is dumped when it ends, once its workers have stopped. */
+static char *dump_on_end()
+{
+    actor_id_t leader;
+    actor_system_config_t config = {.pool_size = 2, .trace_path = TRACE_PATH};
+    reported = 0;
+    remove(TRACE_PATH);
+    mu_assert("system not created", actor_system_create_ex(&leader, &role, &config) == 0);
+    send_message(leader, (message_t){.message_type = MSG_HELLO, .data = (void *)-1L});
+    actor_system_join(leader);
+
+    char *text = read_file(TRACE_PATH);
+    mu_assert("trace not dumped", text != NULL);
+    const char *end = json_value(json_space(text));
+    int parsed = end != NULL && *json_space(end) == '\0';
+
+    // Each thread has its own track, on which B and E events have to nest.
+    long depth[MAX_THREADS] = {0};
+    int nested = 1;
+    long handlers = 0;
+    for (char *line = strtok(text, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        const char *tid = strstr(line, "\"tid\":");
+        const char *phase = strstr(line, "\"ph\":\"");
+        if (tid == NULL || phase == NULL)
+            continue;
+        unsigned long t = strtoul(tid + strlen("\"tid\":"), NULL, 10);
+        if (t >= MAX_THREADS) {
+            nested = 0;
+            break;
+        }
+        phase += strlen("\"ph\":\"");
+        if (*phase == 'B') {
+            ++depth[t];
+            handlers += strstr(line, "\"name\":\"actor ") != NULL;
+        } else if (*phase == 'E' && --depth[t] < 0) {
+            nested = 0;
+        }
+    }
+    for (size_t t = 0; t < MAX_THREADS; ++t)
+        nested = nested && depth[t] == 0;
+    free(text);
+    remove(TRACE_PATH);
+
+    mu_assert("trace is not valid JSON", parsed);
+    mu_assert("begin and end events not balanced", nested);
+    // the leader's hello, spawns, reports and death, the children's hellos, pings and deaths
+    mu_assert("handlers missing", handlers == 2 + 2 * CHILDREN + CHILDREN * (PINGS + 2));
+    return 0;
+}
+
+static char *all_tests()
+{
+    mu_run_test(dump_on_end);
+    return 0;
+}
+
+int main()
+{
+    char *result = all_tests();
+    if (result != 0)
+    {
+        printf(__FILE__ ": %s\n", result);
+    }
+    else
+    {
+        printf(__FILE__ ": ALL TESTS PASSED\n");
+    }
+    printf(__FILE__ ": Tests run: %d\n", tests_run);
+
+    return result != 0;
+}
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+
+#include "timer_wheel.h"
+#include "err.h"
+
+#define MASK (WHEEL_SLOTS - 1)
+
+/* Initial number of timer entries */
+#define INITIAL_TIMERS 64
+
+/* Number of ticks covered by the slots of levels below the given one */
+#define SPAN(level) (1L << (WHEEL_BITS * (level)))
+
+void timer_wheel_init(timer_wheel_t *const w, long now) {
+    w->entries = NULL;
+    w->capacity = 0;
+    w->free = TIMER_NONE;
+    for (size_t level = 0; level < WHEEL_LEVELS; ++level) {
+        for (size_t slot = 0; slot < WHEEL_SLOTS; ++slot)
+            w->slots[level][slot] = TIMER_NONE;
+    }
+    w->now = now;
+    w->pending = 0;
+}
+
+void timer_wheel_destroy(timer_wheel_t *const w) {
+    free(w->entries);
+    w->entries = NULL;
+    w->capacity = 0;
+}
+
+static void grow(timer_wheel_t *const w) {
+    size_t capacity = w->capacity > 0 ? 2 * w->capacity : INITIAL_TIMERS;
+    timer_entry_t *entries = realloc(w->entries, capacity * sizeof(timer_entry_t));
+    if (entries == NULL)
+        fatal("realloc failed");
+    for (size_t i = w->capacity; i < capacity; ++i) {
+        entries[i].status = TIMER_FREE;
+        entries[i].generation = 0;
+        entries[i].next = i + 1 < capacity ? i + 1 : w->free;
+    }
+    w->free = w->capacity;
+    w->entries = entries;
+    w->capacity = capacity;
+}
+
+static void release(timer_wheel_t *const w, size_t index) {
+    timer_entry_t *const t = &w->entries[index];
+    t->status = TIMER_FREE;
+    ++t->generation;
+    t->next = w->free;
+    w->free = index;
+}
+
+/* Puts the timer in the slot of the lowest level which reaches its deadline. */
+static void wheel_link(timer_wheel_t *const w, size_t index) {
+    timer_entry_t *const t = &w->entries[index];
+    long deadline = t->deadline > w->now ? t->deadline : w->now;
+    if (deadline - w->now >= SPAN(WHEEL_LEVELS))
+        deadline = w->now + SPAN(WHEEL_LEVELS) - 1; // comes back to the top level later
+    size_t level = 0;
+    while (level + 1 < WHEEL_LEVELS && deadline - w->now >= SPAN(level + 1))
+        ++level;
+
+    t->slot = &w->slots[level][(deadline >> (WHEEL_BITS * level)) & MASK];
+    t->prev = TIMER_NONE;
+    t->next = *t->slot;
+    if (t->next != TIMER_NONE)
+        w->entries[t->next].prev = index;
+    *t->slot = index;
+    t->status = TIMER_PENDING;
+    ++w->pending;
+}
+
+static void wheel_unlink(timer_wheel_t *const w, size_t index) {
+    timer_entry_t *const t = &w->entries[index];
+    if (t->prev != TIMER_NONE)
+        w->entries[t->prev].next = t->next;
+    else
+        *t->slot = t->next;
+    if (t->next != TIMER_NONE)
+        w->entries[t->next].prev = t->prev;
+    --w->pending;
+}
+
+size_t timer_wheel_add(timer_wheel_t *const w, long deadline, long period, actor_id_t actor,
+        message_t message, unsigned *const generation) {
+    if (w->free == TIMER_NONE)
+        grow(w);
+    size_t index = w->free;
+    timer_entry_t *const t = &w->entries[index];
+    w->free = t->next;
+
+    t->deadline = deadline;
+    t->period = period;
+    t->actor = actor;
+    t->message = message;
+    t->cancelled = false;
+    wheel_link(w, index);
+    *generation = t->generation;
+    return index;
+}
+
+bool timer_wheel_cancel(timer_wheel_t *const w, size_t index, unsigned generation) {
+    if (index >= w->capacity || w->entries[index].generation != generation)
+        return false;
+    timer_entry_t *const t = &w->entries[index];
+    switch (t->status) {
+        case TIMER_PENDING:
+            wheel_unlink(w, index);
+            release(w, index);
+            return true;
+        case TIMER_FIRING:
+            if (t->cancelled)
+                return false;
+            t->cancelled = true;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Moves the timers of the higher level slots the wheel has just reached one level down. */
+static void cascade(timer_wheel_t *const w) {
+    for (size_t level = 1; level < WHEEL_LEVELS && (w->now & (SPAN(level) - 1)) == 0; ++level) {
+        size_t *const slot = &w->slots[level][(w->now >> (WHEEL_BITS * level)) & MASK];
+        size_t index = *slot;
+        *slot = TIMER_NONE;
+        while (index != TIMER_NONE) {
+            size_t next = w->entries[index].next;
+            --w->pending;
+            wheel_link(w, index);
+            index = next;
+        }
+    }
+}
+
+size_t timer_wheel_pop_due(timer_wheel_t *const w, long now) {
+    while (true) {
+        // slots of level 0 hold timers of a single tick
+        size_t index = w->slots[0][w->now & MASK];
+        if (index != TIMER_NONE) {
+            wheel_unlink(w, index);
+            w->entries[index].status = TIMER_FIRING;
+            return index;
+        }
+        if (w->now >= now)
+            return TIMER_NONE;
+        if (w->pending == 0) {
+            w->now = now;
+            continue;
+        }
+        ++w->now;
+        cascade(w);
+    }
+}
+
+void timer_wheel_fired(timer_wheel_t *const w, size_t index, long deadline) {
+    timer_entry_t *const t = &w->entries[index];
+    if (deadline < 0 || t->cancelled) {
+        release(w, index);
+        return;
+    }
+    t->deadline = deadline;
+    wheel_link(w, index);
+}
+
+long timer_wheel_next(timer_wheel_t *const w) {
+    if (w->pending == 0)
+        return -1;
+    // Timers of higher levels may come down only when the wheel turns over level 0.
+    long turn = (w->now | MASK) + 1;
+    for (long tick = w->now; tick < turn; ++tick) {
+        if (w->slots[0][tick & MASK] != TIMER_NONE)
+            return tick;
+    }
+    return turn;
+}
@@ -0,0 +1,74 @@
+#ifndef CACTI_TIMER_WHEEL_H
+#define CACTI_TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cacti.h"
+
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+
+/* Marks the end of a list of timers */
+#define TIMER_NONE ((size_t)-1)
+
+typedef enum {
+    TIMER_FREE,
+    TIMER_PENDING, // in a slot
+    TIMER_FIRING, // taken out by timer_wheel_pop_due
+} timer_status_t;
+
+typedef struct {
+    timer_status_t status;
+    long deadline; // in ticks
+    long period; // in ticks, 0 for a one-shot timer
+    actor_id_t actor;
+    message_t message;
+    unsigned generation; // tells handles of timers reusing the entry apart
+    bool cancelled; // while it was firing
+    size_t prev, next; // in a slot, or in the free list (next only)
+    size_t *slot; // first timer of the slot the timer is in
+} timer_entry_t;
+
+/* Hierarchical timing wheel (G. Varghese, T. Lauck) of WHEEL_LEVELS levels, each of
+ * WHEEL_SLOTS slots. A slot of level l spans WHEEL_SLOTS^l ticks; its timers are
+ * moved to a lower level when the wheel reaches it. Adding and cancelling a timer
+ * is O(1), and so is each tick. Timers live in an array and are linked by indices,
+ * so the array may grow. Not thread-safe. */
+typedef struct {
+    timer_entry_t *entries;
+    size_t capacity;
+    size_t free; // first unused entry
+    size_t slots[WHEEL_LEVELS][WHEEL_SLOTS]; // first timer of each slot
+    long now; // timers due before this tick have fired
+    size_t pending; // timers in slots
+} timer_wheel_t;
+
+void timer_wheel_init(timer_wheel_t *const w, long now);
+
+void timer_wheel_destroy(timer_wheel_t *const w);
+
+/* Adds a timer firing at the deadline tick, or at once if the deadline has passed.
+ * The period is kept for whoever rearms the timer. Returns its entry and sets
+ * *generation. */
+size_t timer_wheel_add(timer_wheel_t *const w, long deadline, long period, actor_id_t actor,
+        message_t message, unsigned *const generation);
+
+/* Returns false if there is no such timer, as it has fired or has been cancelled.
+ * A timer which is firing is freed once it has fired. */
+bool timer_wheel_cancel(timer_wheel_t *const w, size_t index, unsigned generation);
+
+/* Advances the wheel up to the tick now, stopping at the first timer due.
+ * Returns its entry, taken out of the wheel, or TIMER_NONE if no timer is due.
+ * The entry has to be given back with timer_wheel_fired. */
+size_t timer_wheel_pop_due(timer_wheel_t *const w, long now);
+
+/* Puts the timer which has fired back into the wheel, to fire at the deadline tick.
+ * Frees it instead if the deadline is negative or the timer has been cancelled. */
+void timer_wheel_fired(timer_wheel_t *const w, size_t index, long deadline);
+
+/* Returns the first tick at which some timer may be due, or -1 if there are none. */
+long timer_wheel_next(timer_wheel_t *const w);
+
+#endif //CACTI_TIMER_WHEEL_H
@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "topology.h"
+
+#define NODE_DIR "/sys/devices/system/node"
+
+/* Memory policy of mbind(2), which libc does not declare */
+#define MPOL_PREFERRED 1
+
+/* Parses a list such as "0-3,8,10-11" into a set. Returns -1 if it is malformed. */
+static int parse_list(const char *list, cpu_set_t *const set) {
+    CPU_ZERO(set);
+    while (*list != '\0' && *list != '\n') {
+        char *end;
+        long first = strtol(list, &end, 10);
+        if (end == list || first < 0)
+            return -1;
+        long last = first;
+        if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list)
+                return -1;
+        }
+        for (long i = first; i <= last && i < CPU_SETSIZE; ++i)
+            CPU_SET(i, set);
+        list = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+/* Returns -1 if the file cannot be read or its contents are not a list. */
+static int read_list(const char *const path, cpu_set_t *const set) {
+    char line[4096];
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+    int result = fgets(line, sizeof(line), file) != NULL ? parse_list(line, set) : -1;
+    fclose(file);
+    return result;
+}
+
+static void single_node(topology_t *const t) {
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    t->nnodes = 1;
+    t->ids[0] = 0;
+    CPU_ZERO(&t->cpus[0]);
+    for (long i = 0; i < cpus && i < CPU_SETSIZE; ++i)
+        CPU_SET(i, &t->cpus[0]);
+}
+
+void topology_detect(topology_t *const t) {
+    cpu_set_t online, allowed;
+    t->nnodes = 0;
+
+    // Threads bound to CPUs outside of the process' affinity (taskset, cpusets)
+    // could not be created.
+    bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    if (read_list(NODE_DIR "/online", &online) == 0) {
+        for (int id = 0; id < CPU_SETSIZE && t->nnodes < TOPOLOGY_MAX_NODES; ++id) {
+            char path[64];
+            cpu_set_t *const cpus = &t->cpus[t->nnodes];
+            if (!CPU_ISSET(id, &online))
+                continue;
+            snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", id);
+            if (read_list(path, cpus) != 0)
+                continue;
+            if (restricted)
+                CPU_AND(cpus, cpus, &allowed);
+            // nodes with memory only, or with no CPU allowed, are of no use for workers
+            if (CPU_COUNT(cpus) == 0)
+                continue;
+            t->ids[t->nnodes++] = id;
+        }
+    }
+    if (t->nnodes == 0)
+        single_node(t);
+}
+
+void *topology_alloc_on_node(size_t size, int node) {
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED)
+        return NULL;
+#ifdef SYS_mbind
+    // A failing policy (e.g. in a container) leaves the memory to the first touch.
+    unsigned long mask[TOPOLOGY_MAX_NODES / (8 * sizeof(unsigned long))] = {0};
+    if (node >= 0 && (size_t)node < 8 * sizeof(mask)) {
+        mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+        syscall(SYS_mbind, ptr, size, MPOL_PREFERRED, mask, 8 * sizeof(mask) + 1, 0);
+    }
+#endif
+    return ptr;
+}
+
+void topology_free(void *const ptr, size_t size) {
+    munmap(ptr, size);
+}
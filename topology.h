@@ -0,0 +1,29 @@
+#ifndef CACTI_TOPOLOGY_H
+#define CACTI_TOPOLOGY_H
+
+#include <sched.h> // cpu_set_t, needs _GNU_SOURCE
+#include <stddef.h>
+
+/* Maximal number of NUMA nodes taken into account */
+#ifndef TOPOLOGY_MAX_NODES
+#define TOPOLOGY_MAX_NODES 64
+#endif
+
+/* NUMA nodes of the machine and their CPUs, as listed in /sys/devices/system/node */
+typedef struct {
+    size_t nnodes;
+    int ids[TOPOLOGY_MAX_NODES]; // kernel numbers of the nodes
+    cpu_set_t cpus[TOPOLOGY_MAX_NODES];
+} topology_t;
+
+/* Reads the nodes having CPUs the calling process may run on, leaving the others
+ * out of their sets. A machine without NUMA support is a single node. */
+void topology_detect(topology_t *const t);
+
+/* Allocates size bytes (a multiple of the page size) preferably from the memory
+ * of the node with the given kernel number. Returns NULL if mapping fails. */
+void *topology_alloc_on_node(size_t size, int node);
+
+void topology_free(void *const ptr, size_t size);
+
+#endif //CACTI_TOPOLOGY_H
@@ -0,0 +1,87 @@
+#include <stdlib.h>
+
+#include "trace.h"
+
+static const char *const event_names[] = {
+    [TRACE_SEND] = "send",
+    [TRACE_SCHEDULE] = "schedule",
+    [TRACE_DEQUEUE] = "dequeue",
+    [TRACE_SPAWN] = "spawn",
+    [TRACE_GODIE] = "godie",
+};
+
+trace_ring_t *trace_ring_new(bool shared) {
+    trace_ring_t *ring = malloc(sizeof(trace_ring_t));
+    if (ring == NULL)
+        return NULL;
+    atomic_init(&ring->next, 0);
+    ring->shared = shared;
+    return ring;
+}
+
+void trace_epoch_init(trace_epoch_t *const epoch) {
+    epoch->ticks = trace_clock();
+    epoch->nanos = monotonic_nanos();
+}
+
+static int write_event(FILE *const file, const trace_event_t *const event, size_t tid,
+        double micros) {
+    if (fprintf(file, ",\n{\"pid\":0,\"tid\":%zu,\"ts\":%.3f,", tid, micros) < 0)
+        return -1;
+
+    int res;
+    switch (event->type) {
+        case TRACE_HANDLER_START:
+            res = fprintf(file, "\"ph\":\"B\",\"name\":\"actor %ld\","
+                    "\"args\":{\"message_type\":%ld}}", event->actor, event->arg);
+            break;
+        case TRACE_PARK:
+            res = fprintf(file, "\"ph\":\"B\",\"name\":\"parked\"}");
+            break;
+        case TRACE_HANDLER_END:
+        case TRACE_UNPARK:
+            res = fprintf(file, "\"ph\":\"E\"}");
+            break;
+        default:
+            res = fprintf(file, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\","
+                    "\"args\":{\"actor\":%ld,\"arg\":%ld}}",
+                    event_names[event->type], event->actor, event->arg);
+    }
+    return res < 0 ? -1 : 0;
+}
+
+int trace_write_json(FILE *const file, trace_ring_t *const *const rings,
+        const char *const *const names, size_t nrings, const trace_epoch_t *const epoch) {
+    // Ticks are converted to time with the rate measured since the epoch.
+    unsigned long long ticks = trace_clock();
+    long nanos = monotonic_nanos();
+    double nanos_per_tick = ticks > epoch->ticks
+            ? (double)(nanos - epoch->nanos) / (double)(ticks - epoch->ticks) : 1.0;
+
+    if (fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+            "{\"pid\":0,\"ph\":\"M\",\"name\":\"process_name\",\"args\":{\"name\":\"cacti\"}}") < 0)
+        return -1;
+
+    for (size_t tid = 0; tid < nrings; ++tid) {
+        trace_ring_t *const ring = rings[tid];
+        if (fprintf(file, ",\n{\"pid\":0,\"tid\":%zu,\"ph\":\"M\",\"name\":\"thread_name\","
+                "\"args\":{\"name\":\"%s\"}}", tid, names[tid]) < 0)
+            return -1;
+
+        size_t end = atomic_load_explicit(&ring->next, memory_order_acquire);
+        size_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+        for (size_t i = begin; i < end; ++i) {
+            trace_event_t event = ring->events[i % TRACE_RING_SIZE];
+            // the writer may have gone round the ring in the meantime
+            size_t next = atomic_load_explicit(&ring->next, memory_order_acquire);
+            if (next > TRACE_RING_SIZE && i < next - TRACE_RING_SIZE)
+                continue;
+            double micros = nanos_per_tick * (double)(event.ticks - epoch->ticks) / 1000.0;
+            if (event.ticks < epoch->ticks)
+                micros = 0.0;
+            if (write_event(file, &event, tid, micros) != 0)
+                return -1;
+        }
+    }
+    return fprintf(file, "\n]}\n") < 0 ? -1 : 0;
+}
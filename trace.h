@@ -0,0 +1,97 @@
+#ifndef CACTI_TRACE_H
+#define CACTI_TRACE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "cacti.h"
+#include "clock.h"
+
+/* Event tracing, compiled in only if CACTI_TRACE is defined.
+ * Each worker records events in its own ring, which keeps the latest
+ * TRACE_RING_SIZE of them; threads outside of the pool share one ring. */
+
+#ifdef CACTI_TRACE
+#define trace(action) \
+do { \
+    action; \
+} while (0)
+#else
+#define trace(action)
+#endif
+
+#define TRACE_RING_SIZE (1 << 16)
+
+typedef enum {
+    TRACE_SEND, // actor is the receiver, arg the message type
+    TRACE_SCHEDULE,
+    TRACE_DEQUEUE,
+    TRACE_HANDLER_START, // arg is the message type
+    TRACE_HANDLER_END,
+    TRACE_SPAWN, // actor is the new one
+    TRACE_GODIE,
+    TRACE_PARK,
+    TRACE_UNPARK
+} trace_type_t;
+
+typedef struct {
+    unsigned long long ticks; // see trace_clock()
+    trace_type_t type;
+    actor_id_t actor;
+    long arg;
+} trace_event_t;
+
+/* A ring written by many threads claims slots atomically; a ring with
+ * a single writer only publishes how far it got. */
+typedef struct {
+    _Atomic size_t next;
+    bool shared;
+    trace_event_t events[TRACE_RING_SIZE];
+} trace_ring_t;
+
+/* Pairs a clock reading with a wall time, so that ticks can be converted to time. */
+typedef struct {
+    unsigned long long ticks;
+    long nanos;
+} trace_epoch_t;
+
+/* Time stamp counter where there is one, monotonic clock nanoseconds otherwise */
+static inline unsigned long long trace_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (unsigned long long)monotonic_nanos();
+#endif
+}
+
+static inline void trace_record(trace_ring_t *const ring, trace_type_t type,
+        actor_id_t actor, long arg) {
+    size_t i = ring->shared
+            ? atomic_fetch_add_explicit(&ring->next, 1, memory_order_relaxed)
+            : atomic_load_explicit(&ring->next, memory_order_relaxed);
+    trace_event_t *const event = &ring->events[i % TRACE_RING_SIZE];
+    event->ticks = trace_clock();
+    event->type = type;
+    event->actor = actor;
+    event->arg = arg;
+    if (!ring->shared)
+        atomic_store_explicit(&ring->next, i + 1, memory_order_release);
+}
+
+/* Returns NULL if memory cannot be allocated. */
+trace_ring_t *trace_ring_new(bool shared);
+
+void trace_epoch_init(trace_epoch_t *const epoch);
+
+/* Writes events of the rings as Chrome trace JSON, each ring as a separate thread
+ * with the given name. The rings are read without synchronizing with their writers:
+ * events overwritten during the dump are skipped, but an event being written may be
+ * copied half-done. Returns -1 if writing fails. */
+int trace_write_json(FILE *const file, trace_ring_t *const *const rings,
+        const char *const *const names, size_t nrings, const trace_epoch_t *const epoch);
+
+#endif //CACTI_TRACE_H